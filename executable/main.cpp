@@ -3,12 +3,18 @@
 #include <string>
 #include <array>
 #include <regex>
+#include <fstream>
+#include <functional>
+#include <atomic>
+#include <csignal>
 #include "optionparser.h"
 #include "Optimizer.hpp"
 #include "BMAOptimizer.hpp"
+#include "BMAIslandOptimizer.hpp"
 #include "TravelingSalesman.hpp"
 #include "mQAP.hpp"
 #include "QAP.hpp"
+#include "Helpers.hpp"
 
 
 void printError(const char* msg1, const option::Option& opt, const char* msg2)
@@ -93,7 +99,9 @@ enum  optionIndex {
 	LONG_IMPROVEMENT, STAGNATION_ITERATIONS, STAGNATION_MIN, STAGNATION_MAX,
 	TENURE_MIN, TENURE_MAX, JUMP_MAGNITUDE, DIRECTED_PERTUBATION, SMAC, INSTANCE_INFO,
 	CUTOFF_TIME, CUTOFF_LENGTH, TOUR_POOLSIZE, TOUR_MUT_FREQ, TOUR_MUT_STR, TOUR_MUT_GRO,
-	ALGO_TYPE, CROSSOVER_TYPE, PERTURB_TYPE, ANYTIME, TARGET, PRIMARILY_EVOLUTION,
+	ALGO_TYPE, CROSSOVER_TYPE, PERTURB_TYPE, ANYTIME, TARGET, PRIMARILY_EVOLUTION, INSTANCE_CACHE,
+	ISLANDS, MIGRATION_INTERVAL, THREADS, CHECKPOINT, CHECKPOINT_INTERVAL, DELTA_CACHE, REPLACEMENT_TYPE,
+	DESCENT_TYPE, DESCENT_PASSES,
 };
 
 const option::Descriptor usage[] =
@@ -127,7 +135,10 @@ const option::Descriptor usage[] =
 	{ TOUR_MUT_STR,	0, "", "tournament_min_mutation_strength", floatingPoint,	"  --tournament_min_mutation_strength  \tThe tournament mutation strength for BMA" },
 	{ TOUR_MUT_GRO,	0, "", "tournament_mutation_growth", unsignedInteger,	"  --tournament_mutation_growth  \tThe tournament mutation growth for BMA" },
 	{ CROSSOVER_TYPE,	0, "", "crossover_type", required,	"  --crossover_type uniform|partially_matched \tThe crossover type for BMA" },
-	{ PERTURB_TYPE,	0, "", "perturb_type", required,	"  --perturb_type normal|annealed|disabled \tThe perturb type for BMA" },
+	{ PERTURB_TYPE,	0, "", "perturb_type", required,	"  --perturb_type normal|annealed|robust_tabu|disabled \tThe perturb type for BMA" },
+	{ REPLACEMENT_TYPE,	0, "", "replacement_type", required,	"  --replacement_type worst|quality_and_distance \tThe population member that a child replaces in BMA" },
+	{ DESCENT_TYPE,	0, "", "descent_type", required,	"  --descent_type steepest|first_improvement \tThe descent of the local search in BMA" },
+	{ DESCENT_PASSES,	0, "", "descent_passes", unsignedInteger,	"  --descent_passes  \tThe number of first improvement passes before the steepest descent in BMA" },
 	{ SMAC,	0, "", "smac", option::Arg::None,	"  --smac  \tThe output should be in SMAC format" },
 	{ INSTANCE_INFO,	0, "", "instance_info", required,	"  --instance_info  \tThe smac instance information" },
 	{ CUTOFF_TIME,	0, "", "cutoff_time", floatingPoint,	"  --cutoff_time  \tThe smac instance cutoff time" },
@@ -136,6 +147,13 @@ const option::Descriptor usage[] =
 	{ ANYTIME,	0, "", "anytime", unsignedInteger,	"  --anytime snapshot_delay \tTake snapshots regularly to optimize for any time" },
 	{ TARGET,	0, "", "target", floatingPoint,	"  --target targetValue \tRun until target value is achieved" },
 	{ PRIMARILY_EVOLUTION,	0, "", "primarily_evolution", unsignedInteger,	"  --primarily_evolution \tPrimarily use evolution" },
+	{ INSTANCE_CACHE,	0, "", "instance_cache", option::Arg::None,	"  --instance_cache \tCache the parsed QAP instance in a binary file next to it" },
+	{ ISLANDS,	0, "", "islands", unsignedInteger,	"  --islands numThreads \tRun the BMA as an island model with one island per thread" },
+	{ MIGRATION_INTERVAL,	0, "", "migration_interval", unsignedInteger,	"  --migration_interval generations \tThe number of generations between the migrations of the island model" },
+	{ THREADS,	0, "", "threads", unsignedInteger,	"  --threads numThreads \tImprove the population and numThreads children per generation in parallel" },
+	{ CHECKPOINT,	0, "", "checkpoint", required,	"  --checkpoint filename \tSave the BMA state regularly and on SIGTERM, and continue from the file if it exists" },
+	{ CHECKPOINT_INTERVAL,	0, "", "checkpoint_interval", floatingPoint,	"  --checkpoint_interval seconds \tThe wall clock time between the checkpoints" },
+	{ DELTA_CACHE,	0, "", "delta_cache", unsignedInteger,	"  --delta_cache megabytes \tKeep the delta matrices of the improved solutions in up to this much memory per thread" },
 	{ 0,0,0,0,0,0 }
 };
 
@@ -192,14 +210,40 @@ int burma14(float minT, float maxT, int numSteps, float fast_minT, float fast_ma
 	return oneDimensionalAnnealing<13>(salesman, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, numEvaluations, seed);
 }
 
+// Generated from the sizes of the instances in tests/QAPData, with a few extra sizes in between the big ones.
+// Every other size is padded with dummy locations to the next size in the list. The optimizers only search the real
+// locations and scale their parameters by them, so a padded run behaves like a run of the real size.
+typedef SizeList<10, 12, 14, 15, 16, 17, 18, 19, 20, 21, 22, 24, 25, 26, 27, 28, 30, 32, 35, 36, 40, 42, 49, 50, 56, 60, 64, 70, 72, 80, 81, 90,
+	100, 110, 120, 128, 140, 150, 175, 200, 225, 256> QAPSizes;
+
+// With the instance cache the parsed instance is stored in a binary file next to the text file, which later runs map directly
+detail::QAPInstance loadQAPInstance(const std::string& filename, bool useCache)
+{
+	if (useCache)
+	{
+		return detail::loadQAPInstance(filename, filename + ".qapbin");
+	}
+	return detail::loadQAPInstance(filename);
+}
+
+template<typename Result>
+std::function<Result()> unsupportedSize(size_t numLocations, Result result)
+{
+	return [numLocations, result]()
+	{
+		fprintf(stderr, "ERROR: Instances with %zu locations are not supported\n", numLocations);
+		return result;
+	};
+}
+
 template<size_t NumLocations, size_t NumObjectives>
-int mqap_helper(const std::string filename, float minT, float maxT, int numSteps, float fast_minT, float fast_maxT, int fast_numSteps, float pareto_minT, float pareto_maxT, float pareto_equalMultiplier,
+int mqap_helper(const detail::mQAPInstance& instance, float minT, float maxT, int numSteps, float fast_minT, float fast_maxT, int fast_numSteps, float pareto_minT, float pareto_maxT, float pareto_equalMultiplier,
 	unsigned int numEvaluations, unsigned int population, unsigned int seed, const std::string outputFile)
 {
 	std::vector<mQAP<NumLocations>> objectives;
 	for (size_t i = 0; i < NumObjectives; i++)
 	{
-		mQAP<NumLocations> objective(filename, i);
+		mQAP<NumLocations> objective(instance, i);
 		objectives.push_back(objective);
 	}
 	Optimizer<NumLocations, NumObjectives, 32> o(seed);
@@ -223,59 +267,50 @@ int mqap_helper(const std::string filename, float minT, float maxT, int numSteps
 	return 0;
 }
 
+// The sizes of the mQAP instances, smaller instances are padded to the next size
+typedef SizeList<10, 20, 30> mQAPSizes;
+
 int mqap(const std::string filename, float minT, float maxT, int numSteps, float fast_minT, float fast_maxT, int fast_numSteps, float pareto_minT, float pareto_maxT, float pareto_equalMultiplier,
 	unsigned int numEvaluations, unsigned int population, unsigned int seed, const std::string outputFile)
 {
-	auto regex = std::regex("KC(.*)-(.)fl");
-	std::smatch match;
-	std::regex_search(filename, match, regex);
-	int numLocations = std::stoi(match.str(1));
-	int numObjectives = std::stoi(match.str(2));
-	if (numLocations == 10)
-	{
-		if (numObjectives == 2)
-		{
-			return mqap_helper<10, 2>(filename, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, pareto_minT, pareto_maxT, pareto_equalMultiplier, numEvaluations, population, seed, outputFile);
-		}
-		else if (numObjectives == 3)
-		{
-			return mqap_helper<10, 3>(filename, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, pareto_minT, pareto_maxT, pareto_equalMultiplier, numEvaluations, population, seed, outputFile);
-		}
-	}
-	else if (numLocations == 20)
+	// The instance is parsed once and shared by all the objectives
+	auto instance = detail::loadmQAPInstance(filename);
+	size_t numLocations = instance.m_numLocations;
+	size_t numObjectives = instance.m_numObjectives;
+	return dispatchSize(mQAPSizes(), numLocations, [&](auto size)
 	{
+		const size_t NumLocations = decltype(size)::value;
 		if (numObjectives == 2)
 		{
-			return mqap_helper<20, 2>(filename, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, pareto_minT, pareto_maxT, pareto_equalMultiplier, numEvaluations, population, seed, outputFile);
+			return mqap_helper<NumLocations, 2>(instance, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, pareto_minT, pareto_maxT, pareto_equalMultiplier, numEvaluations, population, seed, outputFile);
 		}
 		else if (numObjectives == 3)
 		{
-			return mqap_helper<20, 3>(filename, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, pareto_minT, pareto_maxT, pareto_equalMultiplier, numEvaluations, population, seed, outputFile);
+			return mqap_helper<NumLocations, 3>(instance, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, pareto_minT, pareto_maxT, pareto_equalMultiplier, numEvaluations, population, seed, outputFile);
 		}
-	}
-	else if (numLocations == 30)
-	{
-		if (numObjectives == 2)
-		{
-			return mqap_helper<30, 2>(filename, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, pareto_minT, pareto_maxT, pareto_equalMultiplier, numEvaluations, population, seed, outputFile);
-		}
-		else if (numObjectives == 3)
-		{
-			return mqap_helper<30, 3>(filename, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, pareto_minT, pareto_maxT, pareto_equalMultiplier, numEvaluations, population, seed, outputFile);
-		}
-	}
-	return 0;
+		return 0;
+	}, unsupportedSize(numLocations, 0));
+}
+
+// Set on SIGTERM, so that a checkpointed run can save its state before exiting
+std::atomic<bool> terminateRequested(false);
+
+extern "C" void requestTermination(int)
+{
+	terminateRequested = true;
 }
 
 template<size_t NumLocations>
-std::tuple<int64_t, double, double> qap_bma_helper(const std::string filename, size_t population, size_t longDepth, size_t stagnationIters,
+std::tuple<int64_t, double, double> qap_bma_helper(const detail::QAPInstance& instance, size_t population, size_t longDepth, size_t stagnationIters,
 	float stagnationMinMag, float stagnationMaxMag, float jumpMagnitude, float minDirectedPertubation, float tenureMin, float tenureMax,
 	size_t tournamentPoolSize, size_t mutationFreuency, float minMutationStrength, size_t mutationStrengthGrowth, 
-	CrossoverType crossoverType, PerturbType perturbType, float min_t, float cutOffTime, unsigned int evaluations, unsigned int seed, double* target, bool primarilyEvolution)
+	CrossoverType crossoverType, PerturbType perturbType, ReplacementType replacementType, DescentType descentType, size_t descentPasses, float min_t, float cutOffTime, unsigned int evaluations, unsigned int seed, double* target, bool primarilyEvolution,
+	size_t islands, size_t migrationInterval, size_t threads, const std::string& checkpoint, double checkpointInterval, size_t deltaCacheBytes)
 {
-	QAP<NumLocations> objective(filename);
+	// QAP costs are integers, so they are kept exact all the way through the optimizer
+	QAP<NumLocations, int64_t> objective(instance);
 	Keyboard<NumLocations> keyboard;
-	BMAOptimizer<NumLocations, double> o(seed);
+	BMAOptimizer<NumLocations, int64_t> o(seed);
 	o.populationSize(population);
 	o.improvementDepth(longDepth);
 	o.stagnation(stagnationIters, stagnationMinMag, stagnationMaxMag);
@@ -286,46 +321,82 @@ std::tuple<int64_t, double, double> qap_bma_helper(const std::string filename, s
 	o.crossover(crossoverType);
 	o.tabuTenure(tenureMin, tenureMax);
 	o.perturbType(perturbType);
+	o.replacement(replacementType);
+	o.descent(descentType, descentPasses);
 	o.annealing(min_t);
 	o.primarilyEvolution(primarilyEvolution);
-	o.maxTime(static_cast<double>(cutOffTime));
+	o.threads(threads);
+	objective.threadPool(o.threadPool());
+	o.deltaCache(deltaCacheBytes);
+	if (!checkpoint.empty())
+	{
+		o.checkpoint(checkpoint, checkpointInterval);
+		o.stopFlag(&terminateRequested);
+	}
+	// The process time grows with the number of threads, so parallel runs are limited by the wall clock time instead
+	if (threads > 1)
+	{
+		o.maxWallTime(static_cast<double>(cutOffTime));
+	}
+	else
+	{
+		o.maxTime(static_cast<double>(cutOffTime));
+	}
 	if (target)
 	{
-		o.target(*target);
+		o.target(static_cast<int64_t>(std::llround(*target)));
+	}
+
+	if (islands > 1)
+	{
+		// The islands measure the time in wall clock time, since the process time grows with the number of threads
+		o.maxTime(std::numeric_limits<double>::max());
+		o.maxWallTime(std::numeric_limits<double>::max());
+		BMAIslandOptimizer<NumLocations, int64_t> islandOptimizer(islands, seed);
+		islandOptimizer.migration(migrationInterval, 1, MigrationTopology::Ring);
+		islandOptimizer.maxTime(static_cast<double>(cutOffTime));
+		const auto& solution = islandOptimizer.optimize(o, objective, evaluations);
+		return std::make_tuple(-static_cast<int64_t>(std::get<0>(solution)), islandOptimizer.getFinalTime(), islandOptimizer.getTimeOfBest());
 	}
 
 	const auto& solution = o.optimize(objective, evaluations);
+	if (o.getNumCheckpointFailures() > 0)
+	{
+		std::cerr << "Failed to write " << o.getNumCheckpointFailures() << " checkpoints to " << checkpoint << std::endl;
+	}
+	if (BMAOptimizer<NumLocations, int64_t>::EnableInstrumentation)
+	{
+		writeJson(std::cerr, o.getInstrumentation());
+		std::cerr << std::endl;
+	}
 	return std::make_tuple(-static_cast<int64_t>(std::get<0>(solution)), o.getFinalTime(), o.getTimeOfBest());
 }
 
-std::tuple<int64_t, double, double> qap_bma(const std::string filename, size_t population, size_t longDepth, size_t stagnationIters,
+std::tuple<int64_t, double, double> qap_bma(const detail::QAPInstance& instance, size_t population, size_t longDepth, size_t stagnationIters,
 	float stagnationMinMag, float stagnationMaxMag, float jumpMagnitude, float minDirectedPertubation, float tenureMin, float tenureMax,
 	size_t tournamentPoolSize, size_t mutationFreuency, float minMutationStrength, size_t mutationStrengthGrowth, 
-	CrossoverType crossoverType, PerturbType perturbType, float min_t, float cutOffTime, unsigned int evaluations, unsigned int seed, double* target, bool primarilyEvolution)
+	CrossoverType crossoverType, PerturbType perturbType, ReplacementType replacementType, DescentType descentType, size_t descentPasses, float min_t, float cutOffTime, unsigned int evaluations, unsigned int seed, double* target, bool primarilyEvolution,
+	size_t islands, size_t migrationInterval, size_t threads, const std::string& checkpoint, double checkpointInterval, size_t deltaCacheBytes)
 {
-	std::ifstream stream(filename);
-	int numLocations;
-	stream >> numLocations;
-	if (numLocations == 12)
-	{
-		return qap_bma_helper<12>(filename, population, longDepth, stagnationIters, stagnationMinMag, stagnationMaxMag, jumpMagnitude, 
-			minDirectedPertubation, tenureMin, tenureMax, tournamentPoolSize, mutationFreuency, minMutationStrength, mutationStrengthGrowth,
-			crossoverType, perturbType, min_t, cutOffTime, evaluations, seed, target, primarilyEvolution);
-	}
-	else if (numLocations == 30)
+	size_t numLocations = instance.m_numLocations;
+	return dispatchSize(QAPSizes(), numLocations, [&](auto size)
 	{
-		return qap_bma_helper<30>(filename, population, longDepth, stagnationIters, stagnationMinMag, stagnationMaxMag, jumpMagnitude, 
+		return qap_bma_helper<decltype(size)::value>(instance, population, longDepth, stagnationIters, stagnationMinMag, stagnationMaxMag, jumpMagnitude, 
 			minDirectedPertubation, tenureMin, tenureMax, tournamentPoolSize, mutationFreuency, minMutationStrength, mutationStrengthGrowth,
-			crossoverType, perturbType, min_t, cutOffTime, evaluations, seed, target, primarilyEvolution);
-	}
-	return std::make_tuple(0, 0.0, 0.0);
+			crossoverType, perturbType, replacementType, descentType, descentPasses, min_t, cutOffTime, evaluations, seed, target, primarilyEvolution, islands, migrationInterval, threads, checkpoint, checkpointInterval, deltaCacheBytes);
+	}, unsupportedSize(numLocations, std::make_tuple(int64_t(0), 0.0, 0.0)));
 }
 
-int qap_annealing(const std::string& filename, float minT, float maxT, int numSteps, float fast_minT, float fast_maxT, 
+int qap_annealing(const detail::QAPInstance& instance, float minT, float maxT, int numSteps, float fast_minT, float fast_maxT, 
 	int fast_numSteps, int numEvaluations, unsigned int seed)
 {
-	QAP<12> objective(filename);
-	return oneDimensionalAnnealing<12>(objective, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, numEvaluations, seed);
+	size_t numLocations = instance.m_numLocations;
+	return dispatchSize(QAPSizes(), numLocations, [&](auto size)
+	{
+		const size_t NumLocations = decltype(size)::value;
+		QAP<NumLocations> objective(instance);
+		return oneDimensionalAnnealing<NumLocations>(objective, minT, maxT, numSteps, fast_minT, fast_maxT, fast_numSteps, numEvaluations, seed);
+	}, unsupportedSize(numLocations, 0));
 }
 
 template<typename T, bool IsSigned = std::is_signed<T>::value, size_t NumBytes = sizeof(T)>
@@ -522,6 +593,7 @@ int main(int argc, char* argv[])
 			}
 			else if (test.find("qap") != -1)
 			{
+				auto instance = loadQAPInstance(test, options[INSTANCE_CACHE] != nullptr);
 				std::string algoType = getArgument<std::string>(options, ALGO_TYPE);
 				bool useAnnealing = algoType == "annealing";
 				if (useAnnealing)
@@ -533,7 +605,7 @@ int main(int argc, char* argv[])
 					float fast_minT = getArgument<float>(options, FAST_MINT);
 					float fast_maxT = getArgument<float>(options, FAST_MAXT);
 					int fast_steps = getArgument<int>(options, FAST_NUMSTEPS);
-					auto res = qap_annealing(test, minT, maxT, steps, fast_minT, fast_maxT, fast_steps, evaluations, seed);
+					auto res = qap_annealing(instance, minT, maxT, steps, fast_minT, fast_maxT, fast_steps, evaluations, seed);
 					outputResult(res, 1.0, 1.0, seed, options[SMAC] != nullptr, true);
 
 				}
@@ -568,6 +640,41 @@ int main(int argc, char* argv[])
 						return 1;
 					}
 
+					ReplacementType replacementType = ReplacementType::Worst;
+					if (options[REPLACEMENT_TYPE])
+					{
+						std::string replacementTypeStr = getArgument<std::string>(options, REPLACEMENT_TYPE);
+						if (replacementTypeStr == "quality_and_distance")
+						{
+							replacementType = ReplacementType::QualityAndDistance;
+						}
+						else if (replacementTypeStr != "worst")
+						{
+							std::cout << "Invalid replacement type " << replacementTypeStr;
+							return 1;
+						}
+					}
+
+					DescentType descentType = DescentType::Steepest;
+					if (options[DESCENT_TYPE])
+					{
+						std::string descentTypeStr = getArgument<std::string>(options, DESCENT_TYPE);
+						if (descentTypeStr == "first_improvement")
+						{
+							descentType = DescentType::FirstImprovement;
+						}
+						else if (descentTypeStr != "steepest")
+						{
+							std::cout << "Invalid descent type " << descentTypeStr;
+							return 1;
+						}
+					}
+					size_t descentPasses = 1;
+					if (options[DESCENT_PASSES])
+					{
+						descentPasses = getArgument<size_t>(options, DESCENT_PASSES);
+					}
+
 					std::string perturbTypeStr = getArgument<std::string>(options, PERTURB_TYPE);
 					PerturbType perturbType = PerturbType::Normal;
 					size_t stagnationIters = 0;
@@ -598,6 +705,12 @@ int main(int argc, char* argv[])
 						tenureMin = getArgument<float>(options, TENURE_MIN);
 						tenureMax = getArgument<float>(options, TENURE_MAX);
 					}
+					else if (perturbTypeStr == "robust_tabu")
+					{
+						perturbType = PerturbType::RobustTabu;
+						tenureMin = getArgument<float>(options, TENURE_MIN);
+						tenureMax = getArgument<float>(options, TENURE_MAX);
+					}
 					else if (perturbTypeStr == "disabled")
 					{
 						perturbType = PerturbType::Disabled;
@@ -619,10 +732,42 @@ int main(int argc, char* argv[])
 
 					bool primarilyEvolution = getArgument<unsigned int>(options, PRIMARILY_EVOLUTION) != 0;
 
+					size_t islands = 1;
+					size_t migrationInterval = 20;
+					size_t threads = 1;
+					if (options[ISLANDS])
+					{
+						islands = getArgument<size_t>(options, ISLANDS);
+					}
+					if (options[MIGRATION_INTERVAL])
+					{
+						migrationInterval = getArgument<size_t>(options, MIGRATION_INTERVAL);
+					}
+					if (options[THREADS])
+					{
+						threads = getArgument<size_t>(options, THREADS);
+					}
+					std::string checkpoint;
+					double checkpointInterval = 600.0;
+					if (options[CHECKPOINT])
+					{
+						checkpoint = getArgument<std::string>(options, CHECKPOINT);
+						std::signal(SIGTERM, requestTermination);
+					}
+					if (options[CHECKPOINT_INTERVAL])
+					{
+						checkpointInterval = getArgument<double>(options, CHECKPOINT_INTERVAL);
+					}
+					size_t deltaCacheBytes = 0;
+					if (options[DELTA_CACHE])
+					{
+						deltaCacheBytes = getArgument<size_t>(options, DELTA_CACHE) * 1024 * 1024;
+					}
+
 					
-					auto res = qap_bma(test, population, longDepth, stagnationIters, stagnationMin, stagnationMax, jumpMagnitude, 
+					auto res = qap_bma(instance, population, longDepth, stagnationIters, stagnationMin, stagnationMax, jumpMagnitude, 
 						directedPertubation, tenureMin, tenureMax, tournamentPoolSize, tournamentMutationFrequency, tournamentMutationStrength, tournamentMutGrowth, 
-						ct, perturbType, minT, cutOffTime, evaluations, seed, target, primarilyEvolution);
+						ct, perturbType, replacementType, descentType, descentPasses, minT, cutOffTime, evaluations, seed, target, primarilyEvolution, islands, migrationInterval, threads, checkpoint, checkpointInterval, deltaCacheBytes);
 					outputResult(std::get<0>(res), std::get<1>(res), std::get<2>(res), seed, options[SMAC] != nullptr, true, cutOffTime);
 				}
 			}
@@ -0,0 +1,202 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "BMAOptimizer.hpp"
+
+enum class MigrationTopology
+{
+	Ring,
+	Random,
+};
+
+// Island model of the BMA. Each island is a BMAOptimizer running on its own thread with its own random stream.
+// Every few generations the islands send copies of their best elites to another island, where they replace the worst solutions.
+// All the islands stop as soon as one of them reaches the target.
+template<size_t KeyboardSize, typename FloatingPoint = float, typename RandomGenerator = Xoshiro256StarStar>
+class BMAIslandOptimizer
+{
+	typedef std::chrono::steady_clock Clock;
+public:
+	typedef BMAOptimizer<KeyboardSize, FloatingPoint, RandomGenerator> Island;
+	typedef std::tuple<FloatingPoint, Keyboard<KeyboardSize>> Solution;
+
+	BMAIslandOptimizer(size_t numIslands, unsigned int seed = std::random_device()())
+		: m_numIslands(std::max<size_t>(numIslands, 1))
+		, m_seed(seed)
+	{
+	}
+
+	// Every interval generations each island sends its numMigrants best elites to the next island in the ring, or to a random island
+	void migration(size_t interval, size_t numMigrants, MigrationTopology topology)
+	{
+		m_migrationInterval = std::max<size_t>(interval, 1);
+		m_numMigrants = numMigrants;
+		m_topology = topology;
+	}
+
+	// The wall clock time limit in seconds
+	void maxTime(double t)
+	{
+		m_maxTime = t;
+	}
+
+	// The islands are copies of the prototype, which holds the settings, the target and the per island evaluation budget
+	template<typename Objective>
+	const Solution& optimize(const Island& prototype, const Objective& objective, size_t numEvaluations)
+	{
+		m_startTime = Clock::now();
+		m_bestSolution = std::make_tuple(std::numeric_limits<FloatingPoint>::lowest(), Keyboard<KeyboardSize>());
+		m_timeOfBest = std::numeric_limits<double>::max();
+		m_numEvaluations = 0;
+		m_islands.assign(m_numIslands, prototype);
+		m_inboxes.assign(m_numIslands, std::vector<Solution>());
+		m_stop = false;
+		size_t numRunning = m_numIslands;
+
+		// Island i runs on the stream 2 * i of the seed and migrates with the stream 2 * i + 1, so that all the random
+		// streams are independent
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < m_numIslands; i++)
+		{
+			threads.emplace_back([this, i, &objective, numEvaluations, &numRunning]()
+			{
+				Island& island = m_islands[i];
+				RandomGenerator randomGenerator = detail::randomStream<RandomGenerator>(m_seed, 2 * i + 1);
+				size_t generation = 0;
+				island.seed(m_seed, 2 * i);
+				island.stopFlag(&m_stop);
+				// The islands would all write to the same checkpoint file and snapshot sink
+				island.checkpoint(std::string(), 0.0);
+				island.snapshotSink(nullptr);
+				// The copies share the thread pool of the prototype, which would run the islands one at a time
+				island.threads(island.threadPool() ? island.threadPool()->size() : 1);
+				island.generationCallback([this, i, &island, &randomGenerator, &generation]()
+				{
+					generation++;
+					if (generation % m_migrationInterval == 0)
+					{
+						migrate(i, randomGenerator);
+					}
+					reportBest(island);
+				});
+				island.optimize(objective, numEvaluations);
+				reportBest(island);
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_numEvaluations += island.getNumEvaluations();
+				if (island.targetReached())
+				{
+					m_stop = true;
+				}
+				numRunning--;
+				m_finished.notify_all();
+			});
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			auto done = [&numRunning, this]() { return numRunning == 0 || m_stop; };
+			if (m_maxTime < std::numeric_limits<double>::max())
+			{
+				m_finished.wait_for(lock, std::chrono::duration<double>(m_maxTime), done);
+			}
+			else
+			{
+				m_finished.wait(lock, done);
+			}
+			m_stop = true;
+		}
+		for (auto&& thread : threads)
+		{
+			thread.join();
+		}
+		m_finalTime = getCurrentTime();
+		return m_bestSolution;
+	}
+
+	size_t getNumEvaluations() const
+	{
+		return m_numEvaluations;
+	}
+
+	// The wall clock time of the whole optimization
+	double getFinalTime() const
+	{
+		return m_finalTime;
+	}
+
+	// The wall clock time when the best solution was found, with the resolution of one generation
+	double getTimeOfBest() const
+	{
+		return m_timeOfBest;
+	}
+
+private:
+	double getCurrentTime() const
+	{
+		return std::chrono::duration<double>(Clock::now() - m_startTime).count();
+	}
+
+	void migrate(size_t from, RandomGenerator& randomGenerator)
+	{
+		if (m_numIslands < 2)
+		{
+			return;
+		}
+		size_t to = (from + 1) % m_numIslands;
+		if (m_topology == MigrationTopology::Random)
+		{
+			to = detail::randomIndex(randomGenerator, m_numIslands - 1);
+			if (to >= from)
+			{
+				to++;
+			}
+		}
+		auto migrants = m_islands[from].bestElites(m_numMigrants);
+		std::vector<Solution> arrived;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto& inbox = m_inboxes[to];
+			inbox.insert(inbox.end(), migrants.begin(), migrants.end());
+			std::swap(arrived, m_inboxes[from]);
+		}
+		for (auto&& migrant : arrived)
+		{
+			m_islands[from].immigrate(std::get<1>(migrant), std::get<0>(migrant));
+		}
+	}
+
+	void reportBest(const Island& island)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (std::get<0>(island.getBestSolution()) > std::get<0>(m_bestSolution))
+		{
+			m_bestSolution = island.getBestSolution();
+			m_timeOfBest = getCurrentTime();
+		}
+	}
+
+	size_t m_numIslands;
+	unsigned int m_seed;
+	size_t m_migrationInterval = 20;
+	size_t m_numMigrants = 1;
+	MigrationTopology m_topology = MigrationTopology::Ring;
+	double m_maxTime = std::numeric_limits<double>::max();
+
+	std::vector<Island> m_islands;
+	// The migrants waiting for each island, protected by the mutex
+	std::vector<std::vector<Solution>> m_inboxes;
+	std::mutex m_mutex;
+	std::condition_variable m_finished;
+	std::atomic<bool> m_stop;
+	Solution m_bestSolution;
+	Clock::time_point m_startTime;
+	double m_finalTime = 0.0;
+	double m_timeOfBest = std::numeric_limits<double>::max();
+	size_t m_numEvaluations = 0;
+};
@@ -1,20 +1,32 @@
 #pragma once
-#define NOMINMAX
-#define VC_EXTRALEAN
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
 #include <functional>
 #include "Keyboard.hpp"
 #include "NonDominatedSet.hpp"
+#include "Helpers.hpp"
 #include <random>
 #include <vector>
 #include <utility>
 #include <numeric>
 #include <set>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
 #include "Optimizer.hpp"
-
-template<size_t KeyboardSize, typename FloatingPoint>
-class Objective;
+#include "Objective.hpp"
+#include "Budget.hpp"
+#include "HashIndex.hpp"
+#include "BinaryFile.hpp"
+#include "SnapshotSink.hpp"
+#include "Instrumentation.hpp"
+#include "DeltaCache.hpp"
+#include "Random.hpp"
+#include "ThreadPool.hpp"
 
 // The algorithm is based on "Memetic search for the quadratic assignment problem" (Una Benlic and Jin-Kao Hao)
 
@@ -24,26 +36,50 @@ enum class CrossoverType
 	PartiallyMatched,
 };
 
+enum class ReplacementType
+{
+	// The child replaces the worst member of the population
+	Worst,
+	// The member with the lowest goodness score of Benlic and Hao, which weighs the cost against the distance to the
+	// closest other member, leaves the population
+	QualityAndDistance,
+};
+
+enum class DescentType
+{
+	// Every move of the descent is the best move of the delta matrix
+	Steepest,
+	// The descent from the start of a local search makes the first improving move it finds, skipping the locations
+	// whose moves haven't improved since they last changed (don't look bits). The moves are evaluated one by one
+	// without a delta matrix, which is built when the passes are done, and a steepest descent finishes the descent.
+	// The descents after the perturbations, and from the keyboards with a cached delta matrix, stay steepest
+	FirstImprovement,
+};
+
 enum class PerturbType
 {
 	Disabled,
 	Normal,
 	Annealed,
+	// The local search is a robust tabu search instead of a descent with perturbations
+	RobustTabu,
 };
 
-template<size_t KeyboardSize, typename FloatingPoint = float>
+// RandomGenerator is Xoshiro256StarStar, Philox4x32 or a standard engine with a full range of 32 or 64 bits
+template<size_t KeyboardSize, typename FloatingPoint = float, typename RandomGenerator = Xoshiro256StarStar>
 class BMAOptimizer
 {
 	static std::random_device rd;
 	static const bool EnableLog = false;
+	typedef detail::CostTraits<FloatingPoint> Cost;
 public:
-	typedef std::vector<std::pair<std::tuple<FloatingPoint, Keyboard<KeyboardSize>>, size_t>> SnapshotArray;
+	typedef std::function<void(const Snapshot<KeyboardSize, FloatingPoint>&)> SnapshotSink;
+	static const bool EnableInstrumentation = BMA_INSTRUMENTATION != 0;
 
 
-	BMAOptimizer(unsigned int seed = BMAOptimizer::rd())
+	BMAOptimizer(unsigned int seed = BMAOptimizer::rd()) :
+		m_randomGenerator(detail::randomStream<RandomGenerator>(seed, 0))
 	{
-		startTimer();
-		m_randomGenerator.seed(seed);
 	}
 
 	void populationSize(size_t size)
@@ -101,9 +137,31 @@ public:
 		m_perturbType = perturb;
 	}
 
-	void snapshots(size_t snapshotEvery)
+	void replacement(ReplacementType t)
+	{
+		m_replacementType = t;
+	}
+
+	// The number of passes over the locations of the first improvement descent. The last passes only find a few moves
+	// but evaluate most of the neighbourhood, which is cheaper with a delta matrix. Doesn't apply to the robust tabu search
+	void descent(DescentType t, size_t firstImprovementPasses = 1)
 	{
-		m_snapshotEvery = snapshotEvery;
+		m_descentType = t;
+		m_firstImprovementPasses = std::max<size_t>(firstImprovementPasses, 1);
+	}
+
+	// The weight of the quality in the goodness score of the quality and distance replacement, and the probability of
+	// replacing the second lowest scoring member when the child scores lowest itself. Benlic and Hao use 0.6 and 0.3
+	void goodnessScore(float qualityWeight, float secondWorstProbability)
+	{
+		m_qualityWeight = qualityWeight;
+		m_secondWorstProbability = secondWorstProbability;
+	}
+
+	// The sink is called with every change of the best solution, at the end of the generation it was found in
+	void snapshotSink(SnapshotSink sink)
+	{
+		m_snapshotSink = std::move(sink);
 	}
 
 	void annealing(float min_t)
@@ -118,12 +176,123 @@ public:
 
 	void target(FloatingPoint target)
 	{
-		m_target = target;
+		m_budget.target(target);
 	}
 
+	// The limit in seconds of process CPU time
 	void maxTime(double t)
 	{
-		m_maxTime = t;
+		m_budget.cpuTime(t);
+	}
+
+	// The limit in seconds of wall clock time. When it's set, the reported times are wall clock times too
+	void maxWallTime(double t)
+	{
+		m_budget.wallTime(t);
+	}
+
+	// The number of threads used for improving the population. With more than one thread, every generation produces
+	// one child per thread and improves them concurrently. The results only depend on the seed and the number of threads.
+	// The threads are started here and kept for all the runs of the optimizer and its copies
+	void threads(size_t numThreads)
+	{
+		m_numThreads = std::max<size_t>(numThreads, 1);
+		m_threadPool = m_numThreads > 1 ? std::make_shared<detail::ThreadPool>(m_numThreads) : nullptr;
+	}
+
+	// The threads of the workers, which the objective can share, or null with a single thread
+	const std::shared_ptr<detail::ThreadPool>& threadPool() const
+	{
+		return m_threadPool;
+	}
+
+	// Runs with the same seed and stream are the same, and runs with different streams of the same seed are independent
+	void seed(unsigned int seed, uint64_t stream = 0)
+	{
+		m_randomGenerator = detail::randomStream<RandomGenerator>(seed, stream);
+	}
+
+	// The optimization stops as soon as the flag is set, it's shared by the islands of BMAIslandOptimizer. When
+	// checkpoints are enabled the flag is only checked between generations, and a final checkpoint is written
+	void stopFlag(const std::atomic<bool>* stop)
+	{
+		m_stop = stop;
+	}
+
+	// Writes the state of the run to the file every interval seconds of wall clock time, and when the run is stopped
+	// by the stop flag. If the file exists when optimize is called, the run continues from it, exactly as it would
+	// have continued without the interruption when the settings and the number of threads are the same. The file
+	// is removed when the run finishes. An empty filename disables the checkpoints. A checkpoint that can't be written
+	// doesn't stop the run, the failures are counted by getNumCheckpointFailures
+	void checkpoint(const std::string& filename, double interval)
+	{
+		m_checkpointFile = filename;
+		m_checkpointInterval = interval;
+	}
+
+	// Keeps the delta matrices of the local search results in up to maxBytes per thread, so that the searches that start
+	// from them again, or from a few swaps away after a mutation or a crossover, don't rebuild the matrices. The evaluations are counted as if
+	// the matrices were rebuilt, and the costs are exact, so the cache doesn't change the course of the run, except that the first
+	// improvement descent is skipped by the searches that start from a cached matrix. Zero disables the cache
+	void deltaCache(size_t maxBytes)
+	{
+		// With floating point costs the updated matrices differ from the rebuilt ones by the rounding errors, which
+		// would make the runs depend on the cache
+		static_assert(Cost::IsExact, "The delta cache needs a cost type with exact arithmetic");
+		m_deltaCache.capacity(maxBytes);
+	}
+
+	// The elite archive keeps at most capacity distinct solutions. When it's full, a new solution replaces the elite
+	// closest to it if they differ in fewer than minDistance * n keys, where n is the number of locations of the objective, and otherwise the worst elite. It's
+	// only accepted when it's better than the elite it would replace, so similar elites compete with each other
+	void eliteArchive(size_t capacity, float minDistance)
+	{
+		m_eliteCapacity = std::max<size_t>(capacity, 1);
+		m_eliteMinDistance = minDistance;
+	}
+
+	// Called after every generation
+	void generationCallback(std::function<void()> callback)
+	{
+		m_generationCallback = std::move(callback);
+	}
+
+	// The best count solutions of the elite archive, best first
+	std::vector<std::tuple<FloatingPoint, Keyboard<KeyboardSize>>> bestElites(size_t count) const
+	{
+		std::vector<const Elite*> elites;
+		for (auto&& elite : m_elites)
+		{
+			elites.push_back(&elite);
+		}
+		count = std::min(count, elites.size());
+		std::partial_sort(elites.begin(), elites.begin() + count, elites.end(), [](const Elite* lhs, const Elite* rhs)
+		{
+			return CompareElite()(*rhs, *lhs);
+		});
+		std::vector<std::tuple<FloatingPoint, Keyboard<KeyboardSize>>> ret;
+		for (size_t i = 0; i < count; i++)
+		{
+			ret.emplace_back(elites[i]->m_solution, elites[i]->m_keyboard);
+		}
+		return ret;
+	}
+
+	// Replaces the worst solution of the population with the migrant when it's better and not already in the population
+	void immigrate(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution)
+	{
+		auto worst = std::min_element(m_populationSolutions.begin(), m_populationSolutions.end());
+		if (worst != m_populationSolutions.end() && solution > *worst)
+		{
+			const uint64_t hash = keyboard.hash();
+			replaceSolution(keyboard, solution, hash);
+			updateEliteArchive(keyboard, solution, hash);
+		}
+	}
+
+	bool targetReached() const
+	{
+		return m_budget.targetReached(std::get<0>(m_bestSolution));
 	}
 
 	template<typename Objective>
@@ -136,90 +305,144 @@ public:
 	const std::tuple<FloatingPoint, Keyboard<KeyboardSize>>& optimize(const Objective& objective, size_t numEvaluations)
 	{
 		static_assert(std::is_same<typename Objective::floating_point_t, FloatingPoint>::value, "The objective function uses a different floating point format than the optimizer");
-		m_numEvaluationsLeft = static_cast<int>(numEvaluations);
-		m_totalEvaluations = numEvaluations;
-		generateRandomPopulation(objective);
-		shortImprovement(true, objective);
-		updateBestSolution();
-		updateEliteArchive();
-		size_t numWithoutImprovement = 0;
-		size_t numCounter = 0;
+		// Stopping in the middle of a generation would leave a state that the run can't be continued from exactly
+		const bool checkpoints = !m_checkpointFile.empty();
+		m_budget.stopFlag(checkpoints ? nullptr : m_stop);
+		m_budget.evaluations(numEvaluations);
+		m_budget.start();
+		m_instrumentation.clear();
+		m_numCheckpointFailures = 0;
+		m_numLocations = objective.numLocations();
+		createWorkers();
+		if (!checkpoints || !readCheckpoint())
+		{
+			generateRandomPopulation(objective);
+			shortImprovement(true, objective);
+			updateBestSolution();
+			updateEliteArchive();
+			m_numWithoutImprovement = 0;
+			m_numMutations = 0;
+			updateTimeOfBest();
+		}
 
-		FloatingPoint solution;
-		updateTimeOfBest();
-		while(m_numEvaluationsLeft > 0 && m_target - std::get<0>(m_bestSolution) > tolerance && getCurrentTime() < m_maxTime)
-		{
-			size_t num_of_parents = 2;
-			auto parents = parentSelection();
-			auto child = produceChild(m_population[parents.first], m_population[parents.second]);
-			solution = evaluate(child, objective);
-			m_numEvaluationsLeft--;
-			std::tie(child, solution) = localSearch(child, solution, m_imporvementDepth, true, objective);
-			FloatingPoint resultingCost = std::get<0>(m_bestSolution);
-			if (EnableLog)
-				std::cout << std::setprecision(9) << resultingCost << " " << m_numEvaluationsLeft << std::endl;
-			FloatingPoint childCost = solution;
-			if (childCost > resultingCost + tolerance)
-			{
-				numWithoutImprovement = 0;
-				numCounter = 0;
+		std::vector<Candidate> children(std::max<size_t>(m_workers.size(), 1));
+		double lastCheckpoint = m_budget.wallTimeElapsed();
+		while(!m_budget.exhaustedNow(std::get<0>(m_bestSolution)) && !(checkpoints && stopRequested()))
+		{
+			for (size_t i = 0; i < children.size(); i++)
+			{
+				auto& child = children[i];
+				auto parents = parentSelection();
+				std::get<0>(child) = produceChild(m_population[parents.first], m_population[parents.second]);
+				std::get<1>(child) = evaluate(std::get<0>(child), objective);
+				std::get<2>(child) = std::get<0>(child).hash();
+				m_budget.consume(1);
+				if (m_deltaCache.enabled())
+				{
+					// Every worker improves the child with its own index
+					deriveChildDeltas(std::get<0>(child), std::get<2>(child), parents, m_workers.empty() ? m_deltaCache : m_workers[i].m_deltaCache);
+				}
 			}
-			else
+			improveChildren(inOut(children), objective);
+
+			// The children are merged in order, so that the parallel mode is deterministic too
+			for (auto&& child : children)
 			{
-				numWithoutImprovement++;
+				FloatingPoint resultingCost = std::get<0>(m_bestSolution);
+				if (EnableLog)
+					std::cout << std::setprecision(9) << resultingCost << " " << m_budget.evaluationsLeft() << std::endl;
+				FloatingPoint childCost = std::get<1>(child);
+				if (Cost::isImprovement(childCost, resultingCost))
+				{
+					m_numWithoutImprovement = 0;
+					m_numMutations = 0;
+				}
+				else
+				{
+					m_numWithoutImprovement++;
+				}
+				replaceSolution(std::get<0>(child), std::get<1>(child), std::get<2>(child));
+				updateEliteArchive(std::get<0>(child), std::get<1>(child), std::get<2>(child));
 			}
 
-			if (numWithoutImprovement >= m_mutationFrequency)
+			// The whole generation is merged before the population is mutated, so that no improved child is lost
+			if (m_numWithoutImprovement >= m_mutationFrequency)
 			{
-				if (numCounter > m_mutationStrenghtGrowth)
+				if (m_numMutations > m_mutationStrenghtGrowth)
 				{
 					newSolutionsFromElites(objective);
-					numWithoutImprovement = 0;
+					m_numWithoutImprovement = 0;
 					if (EnableLog)
 						std::cout << "New solutions from elites" << std::endl;
-					numCounter = 0;
+					m_numMutations = 0;
 				}
 				// Note that we use if instead of else if here, since the previous if can set the counter to zero
-				if (numWithoutImprovement > 0 && numCounter <= m_mutationStrenghtGrowth)
+				if (m_numWithoutImprovement > 0 && m_numMutations <= m_mutationStrenghtGrowth)
 				{
-					float t = static_cast<float>(numCounter) / m_mutationStrenghtGrowth;
+					float t = static_cast<float>(m_numMutations) / m_mutationStrenghtGrowth;
 					const float tMax = 1.0f - m_mutationStrenghtMin;
 					t *= tMax;
 					size_t mutationStrength = static_cast<size_t>(std::round(m_populationSize * (m_mutationStrenghtMin + t)));
-					mutationStrength = std::max<size_t>(mutationStrength, 1);
-					mutatePopulation(mutationStrength);
-					evaluatePopulation(objective);
+					mutationStrength = std::min(std::max<size_t>(mutationStrength, 1), m_numLocations);
+					{
+						ScopedPhase phase(m_instrumentation, InstrumentationPhase::Mutation);
+						m_instrumentation.count(InstrumentationCounter::Mutations);
+						mutatePopulation(mutationStrength);
+						evaluatePopulation(objective);
+					}
 					updateBestSolution();
 					shortImprovement(true, objective);
-					numWithoutImprovement = 0;
-					numCounter++;
+					m_numWithoutImprovement = 0;
+					m_numMutations++;
 					if (EnableLog)
 						std::cout << "Mutated" << std::endl;
 				}
 				updateBestSolution();
 				updateEliteArchive();
 			}
+			updateTimeOfBest();
+			if (checkpoints && m_budget.wallTimeElapsed() - lastCheckpoint >= m_checkpointInterval)
+			{
+				if (!writeCheckpoint())
+				{
+					m_numCheckpointFailures++;
+				}
+				lastCheckpoint = m_budget.wallTimeElapsed();
+			}
+			if (m_generationCallback)
+			{
+				m_generationCallback();
+			}
+		}
+		if (checkpoints)
+		{
+			if (stopRequested())
+			{
+				if (!writeCheckpoint())
+				{
+					m_numCheckpointFailures++;
+				}
+			}
 			else
 			{
-				replaceSolution(child, solution);
-				updateEliteArchive(child, solution);
+				std::remove(m_checkpointFile.c_str());
 			}
-			updateTimeOfBest();
 		}
 		updateBestSolution();
 		updateTimeOfBest();
-		m_finalTime = getCurrentTime();
+		m_finalTime = m_budget.timeElapsed();
+		m_workers.clear();
 		return m_bestSolution;
 	}
 
-	const SnapshotArray& getSnapshots() const
+	const std::tuple<FloatingPoint, Keyboard<KeyboardSize>>& getBestSolution() const
 	{
-		return m_snapshots;
+		return m_bestSolution;
 	}
 
 	size_t getNumEvaluations() const
 	{
-		return m_totalEvaluations - m_numEvaluationsLeft;
+		return m_budget.evaluationsUsed();
 	}
 
 	double getFinalTime() const
@@ -232,9 +455,63 @@ public:
 		return m_timeOfBest;
 	}
 
+	// The number of checkpoints of the last run that couldn't be written. The run goes on without them
+	size_t getNumCheckpointFailures() const
+	{
+		return m_numCheckpointFailures;
+	}
+
+	// The counters and the phase times of the last run, see Instrumentation.hpp
+	const Instrumentation<EnableInstrumentation>& getInstrumentation() const
+	{
+		return m_instrumentation;
+	}
+
 protected:
+	typedef typename Instrumentation<EnableInstrumentation>::ScopedPhase ScopedPhase;
 	typedef std::array<std::array<FloatingPoint, KeyboardSize>, KeyboardSize> DeltaArray;
-	typedef std::array<std::array<size_t, KeyboardSize>, KeyboardSize> IndexArray;
+	// The iteration of the last swap of every pair i < j, packed row by row
+	typedef std::array<uint32_t, KeyboardSize * (KeyboardSize - 1) / 2> SwapStampArray;
+	typedef std::tuple<size_t, size_t, FloatingPoint> Move;
+	typedef detail::DeltaCache<KeyboardSize, FloatingPoint> DeltaCache;
+	// A keyboard with its cost and Zobrist hash
+	typedef std::tuple<Keyboard<KeyboardSize>, FloatingPoint, uint64_t> Candidate;
+	// The iterations until which the keys are tabu at the positions, indexed by position and key
+	typedef std::array<std::array<uint32_t, KeyboardSize>, KeyboardSize> ExpiryArray;
+
+	// The arrays of the local search are allocated once per optimizer, instead of on the stack of every call
+	struct Workspace
+	{
+		DeltaArray m_delta;
+		SwapStampArray m_lastSwapped;
+		ExpiryArray m_tabu;
+		std::array<std::array<bool, KeyboardSize>, KeyboardSize> m_valid;
+		// The delta matrix of the best keyboard of the local search for the delta cache. It's copied when the search
+		// leaves the best keyboard, so it's only up to date when m_bestPending is false
+		DeltaArray m_bestDelta;
+		Move m_bestMove;
+		bool m_bestPending;
+		std::vector<typename DeltaCache::Swap> m_swaps;
+		std::vector<typename DeltaCache::Swap> m_otherSwaps;
+		std::array<bool, KeyboardSize> m_dontLook;
+	};
+
+	// The number of iterations after which a tabu move is forced, as in Taillard's robust tabu search
+	uint32_t aspirationAge() const
+	{
+		return static_cast<uint32_t>(5 * m_numLocations * m_numLocations);
+	}
+
+	// The evaluations charged for building or updating a delta matrix
+	size_t neighbourhoodSize() const
+	{
+		return m_numLocations * (m_numLocations - 1) / 2;
+	}
+
+	static size_t pairIndex(size_t i, size_t j)
+	{
+		return i * (2 * KeyboardSize - i - 1) / 2 + j - i - 1;
+	}
 
 	template<typename Objective>
 	void generateRandomPopulation(const Objective& objective)
@@ -244,10 +521,11 @@ protected:
 
 		for (auto i = 0; i < m_populationSize; i++)
 		{
-			m_population[i].randomize(m_randomGenerator);
-			m_numEvaluationsLeft--;
+			m_population[i].randomize(m_randomGenerator, m_numLocations);
+			m_budget.consume(1);
 			m_populationSolutions[i] = evaluate(m_population[i], objective);
 		}
+		rebuildPopulationIndex();
 	}
 
 	template<typename Objective>
@@ -255,7 +533,7 @@ protected:
 	{
 		for (auto i = 0; i < m_populationSize; i++)
 		{
-			m_numEvaluationsLeft--;
+			m_budget.consume(1);
 			m_populationSolutions[i] = evaluate(m_population[i], objective);
 		}
 	}
@@ -263,100 +541,276 @@ protected:
 	template<typename Objective>
 	void shortImprovement(bool steepestAscentOnly, const Objective& objective)
 	{
+		if (!m_workers.empty())
+		{
+			std::vector<Candidate> improved(m_populationSize);
+			runOnWorkers(m_populationSize, [&](BMAOptimizer& worker, size_t i)
+			{
+				improved[i] = worker.localSearch(m_population[i], m_populationSolutions[i], m_populationHashes[i], m_imporvementDepth, steepestAscentOnly, objective);
+			});
+			for (size_t i = 0; i < m_populationSize; i++)
+			{
+				replaceIfUnique(i, improved[i]);
+			}
+			return;
+		}
+
 		for (size_t i = 0; i < m_populationSize; i++)
 		{
-			auto& keyboard = m_population[i];
-			auto& solution = m_populationSolutions[i];
-			Keyboard<KeyboardSize> newKeyboard;
-			FloatingPoint newSolution;
-			std::tie(newKeyboard, newSolution) = localSearch(keyboard, solution, m_imporvementDepth, steepestAscentOnly, objective);
-			if (std::find(m_population.begin(), m_population.end(), newKeyboard) == m_population.end())
+			replaceIfUnique(i, localSearch(m_population[i], m_populationSolutions[i], m_populationHashes[i], m_imporvementDepth, steepestAscentOnly, objective));
+		}
+	}
+
+	void replaceIfUnique(size_t index, const Candidate& candidate)
+	{
+		if (!inPopulation(std::get<0>(candidate), std::get<2>(candidate)))
+		{
+			setPopulationMember(index, std::get<0>(candidate), std::get<1>(candidate), std::get<2>(candidate));
+		}
+		else
+		{
+			m_instrumentation.count(InstrumentationCounter::DuplicateRejections);
+		}
+	}
+
+	bool inPopulation(const Keyboard<KeyboardSize>& keyboard, uint64_t hash) const
+	{
+		return m_populationIndex.find(hash, [this, &keyboard](size_t i) { return m_population[i] == keyboard; }) != detail::HashIndex::NotFound;
+	}
+
+	void setPopulationMember(size_t index, const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution, uint64_t hash)
+	{
+		m_populationIndex.erase(m_populationHashes[index], index);
+		m_population[index] = keyboard;
+		m_populationSolutions[index] = solution;
+		m_populationHashes[index] = hash;
+		m_populationIndex.insert(hash, index);
+		if (m_replacementType == ReplacementType::QualityAndDistance)
+		{
+			updatePopulationDistances(index);
+		}
+	}
+
+	// Rehashes the whole population after it has been changed in place
+	void rebuildPopulationIndex()
+	{
+		m_populationHashes.resize(m_population.size());
+		m_populationIndex.clear();
+		for (size_t i = 0; i < m_population.size(); i++)
+		{
+			m_populationHashes[i] = m_population[i].hash();
+			m_populationIndex.insert(m_populationHashes[i], i);
+		}
+		if (m_replacementType == ReplacementType::QualityAndDistance)
+		{
+			m_populationDistances.assign(m_population.size() * m_population.size(), 0);
+			for (size_t i = 0; i < m_population.size(); i++)
+			{
+				updatePopulationDistances(i);
+			}
+		}
+	}
+
+	// The Hamming distances between the members are kept in a matrix, of which only the row and the column of a
+	// replaced member need to be updated
+	void updatePopulationDistances(size_t index)
+	{
+		const size_t size = m_population.size();
+		for (size_t i = 0; i < size; i++)
+		{
+			const uint32_t d = static_cast<uint32_t>(m_population[index].distance(m_population[i]));
+			m_populationDistances[index * size + i] = d;
+			m_populationDistances[i * size + index] = d;
+		}
+	}
+
+	template<typename Objective>
+	void improveChildren(InOut<std::vector<Candidate>> children, const Objective& objective)
+	{
+		if (!m_workers.empty())
+		{
+			runOnWorkers(children.get().size(), [&](BMAOptimizer& worker, size_t i)
+			{
+				auto& child = children.get()[i];
+				child = worker.localSearch(std::get<0>(child), std::get<1>(child), std::get<2>(child), m_imporvementDepth, true, objective);
+			});
+			return;
+		}
+
+		for (auto&& child : children.get())
+		{
+			child = localSearch(std::get<0>(child), std::get<1>(child), std::get<2>(child), m_imporvementDepth, true, objective);
+		}
+	}
+
+	// One copy of the optimizer per thread, each with a random stream of its own. The streams are the streams of a seed
+	// drawn from the main stream, so that they are different on every run of the same optimizer
+	void createWorkers()
+	{
+		m_workers.clear();
+		if (m_numThreads < 2)
+		{
+			return;
+		}
+		BMAOptimizer prototype(*this);
+		prototype.m_threadPool = nullptr;
+		prototype.m_snapshotSink = nullptr;
+		prototype.m_generationCallback = nullptr;
+		prototype.m_checkpointFile.clear();
+		prototype.m_instrumentation.clear();
+		prototype.m_population.clear();
+		prototype.m_populationSolutions.clear();
+		prototype.m_populationHashes.clear();
+		prototype.m_populationIndex.clear();
+		prototype.m_populationDistances.clear();
+		prototype.m_elites.clear();
+		prototype.m_eliteIndex.clear();
+		const uint64_t seed = m_randomGenerator();
+		for (size_t i = 0; i < m_numThreads; i++)
+		{
+			m_workers.push_back(prototype);
+			m_workers.back().m_randomGenerator = detail::randomStream<RandomGenerator>(seed, i);
+		}
+	}
+
+	// Calls task(worker, i) for every i in [0, count). Each worker thread handles a contiguous range, so the
+	// result of every task only depends on the random stream of its worker
+	template<typename Task>
+	void runOnWorkers(size_t count, Task&& task)
+	{
+		const size_t numWorkers = m_workers.size();
+		// The remaining evaluations are split between the workers, so that the total budget is respected
+		const size_t evaluationsPerWorker = static_cast<size_t>(std::max<int64_t>(m_budget.evaluationsLeft() / static_cast<int64_t>(numWorkers), 1));
+		for (auto&& worker : m_workers)
+		{
+			worker.m_budget.evaluations(evaluationsPerWorker);
+			worker.m_bestSolution = m_bestSolution;
+		}
+		m_threadPool->run([this, count, numWorkers, &task](size_t t)
+		{
+			for (size_t i = t * count / numWorkers; i < (t + 1) * count / numWorkers; i++)
 			{
-				keyboard = newKeyboard;
-				solution = newSolution;
+				task(m_workers[t], i);
 			}
+		});
+		for (auto&& worker : m_workers)
+		{
+			m_budget.consume(worker.m_budget.evaluationsUsed());
+			m_instrumentation.merge(worker.m_instrumentation);
+			worker.m_instrumentation.clear();
 		}
 	}
 
 	template<typename Objective>
 	void newSolutionsFromElites(const Objective& objective)
 	{
-		std::vector<Elite> elites(m_eliteSoFar.begin(), m_eliteSoFar.end());
-		std::shuffle(elites.begin(), elites.end(), m_randomGenerator);
-		for (size_t i = 0; i < m_populationSize && i < elites.size(); i++)
+		m_instrumentation.count(InstrumentationCounter::EliteRestarts);
+		// A random sample of distinct elites with Floyd's algorithm, which only draws as many numbers as it samples
+		const size_t count = std::min<size_t>(m_populationSize, m_elites.size());
+		std::vector<size_t> sample;
+		sample.reserve(count);
+		for (size_t j = m_elites.size() - count; j < m_elites.size(); j++)
 		{
-			m_population[i] = elites[i].m_keyboard;
-			m_populationSolutions[i] = elites[i].m_solution;
+			size_t i = detail::randomIndex(m_randomGenerator, j + 1);
+			if (std::find(sample.begin(), sample.end(), i) != sample.end())
+			{
+				i = j;
+			}
+			sample.push_back(i);
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			const Elite& elite = m_elites[sample[i]];
+			setPopulationMember(i, elite.m_keyboard, elite.m_solution, elite.m_hash);
 		}
 		updateBestSolution();
 	}
 
 	template<typename Objective>
-	std::tuple<Keyboard<KeyboardSize>, FloatingPoint> localSearch(Keyboard<KeyboardSize> keyboard, FloatingPoint solution, size_t numIterations, bool steepestAscentOnly, const Objective& objective)
+	Candidate localSearch(Keyboard<KeyboardSize> keyboard, FloatingPoint solution, uint64_t hash, size_t numIterations, bool steepestAscentOnly, const Objective& objective)
 	{
+		ScopedPhase phase(m_instrumentation, InstrumentationPhase::Descent);
+		if (m_perturbType == PerturbType::RobustTabu)
+		{
+			return robustTabuSearch(keyboard, solution, hash, numIterations, steepestAscentOnly, objective);
+		}
 		Keyboard<KeyboardSize> currentKeyboard = keyboard;
+		uint64_t currentHash = hash;
 
-		DeltaArray delta;
-		IndexArray lastSwapped;
-		IndexArray frequency;
+		Workspace& workspace = m_workspace.get();
+		DeltaArray& delta = workspace.m_delta;
+		SwapStampArray& lastSwapped = workspace.m_lastSwapped;
+		Move bestMove;
+		auto searchState = objective.createSearchState();
 
 		size_t iterWithoutImprovement = 0;
 		size_t iterLastImprovement = 0;
 
 		bool hasImproved = true;
 		size_t iteration = 0;
+		size_t firstIteration = 1;
 
-		for (size_t i = 0;i < KeyboardSize;i++)
+		FloatingPoint bestCost = solution;
+		Keyboard<KeyboardSize> prevLocalOptimum = keyboard;
+
+		lastSwapped.fill(0);
+		// A start with a cached matrix already has its neighbourhood, which the steepest descent uses right away
+		const bool cached = m_deltaCache.enabled() && m_deltaCache.find(keyboard, hash);
+		if (m_descentType == DescentType::FirstImprovement && !cached)
 		{
-			lastSwapped[i].fill(0);
-			frequency[i].fill(0);
+			const size_t numMoves = firstImprovementDescent(inOut(keyboard), inOut(solution), inOut(hash), numIterations, inOut(lastSwapped), searchState.get(), objective);
+			currentKeyboard = keyboard;
+			currentHash = hash;
+			iteration += numMoves;
+			firstIteration += numMoves;
 		}
-		computeAllDeltas(currentKeyboard, solution, objective, inOut(delta));
+		initialDeltas(currentKeyboard, solution, hash, objective, inOut(delta), inOut(bestMove), searchState.get());
 
 		FloatingPoint currentCost = solution;
-		FloatingPoint bestCost = solution;
-		Keyboard<KeyboardSize> prevLocalOptimum = keyboard;
 
-		size_t perturbStr = std::max<size_t>(static_cast<size_t>(std::ceil(m_jumpMagnitude * KeyboardSize)), 2);
-		std::uniform_real_distribution<float> stagnationDistribution(m_minStagnationMagnitude, m_maxStagnationMagnitude);
+		size_t perturbStr = std::max<size_t>(static_cast<size_t>(std::ceil(m_jumpMagnitude * m_numLocations)), 2);
 
-		for (size_t currentIteration = 1; currentIteration <= numIterations && m_numEvaluationsLeft > 0 && m_target - std::get<0>(m_bestSolution) > tolerance && getCurrentTime() < m_maxTime; currentIteration++)
+		for (size_t currentIteration = firstIteration; currentIteration <= numIterations && !m_budget.exhausted(std::get<0>(m_bestSolution)); currentIteration++)
 		{
 			size_t iRetained = 0;
 			size_t jRetained = 0;
 			FloatingPoint maxDelta;
 
-			std::tie(iRetained, jRetained, maxDelta) = steepestAscent(delta);
+			std::tie(iRetained, jRetained, maxDelta) = bestMove;
+			m_instrumentation.count(InstrumentationCounter::Iterations);
 
-			if (maxDelta > 0.0f)
+			if (maxDelta > 0)
 			{
-				currentCost = swapKeys(iRetained, jRetained, inOut(currentKeyboard), currentCost, inOut(delta), iteration, inOut(lastSwapped), objective);
-				if (currentCost > solution + tolerance)
+				m_instrumentation.count(InstrumentationCounter::ImprovingMoves);
+				currentCost = swapKeys(iRetained, jRetained, inOut(currentKeyboard), inOut(currentHash), currentCost, inOut(delta), inOut(bestMove), searchState.get(), iteration, inOut(lastSwapped), objective);
+				if (Cost::isImprovement(currentCost, solution))
 				{
 					iterWithoutImprovement = 0;
 					iterLastImprovement = currentIteration;
 					solution = currentCost;
 					keyboard = currentKeyboard;
+					hash = currentHash;
+					workspace.m_bestPending = true;
 				}
 				iteration++;
 				hasImproved = true;
 			}
 			else if (m_perturbType != PerturbType::Disabled)
 			{
-				if (m_primarilyEvolution && !steepestAscentOnly && solution <= bestCost + tolerance)
+				if (m_primarilyEvolution && !steepestAscentOnly && !Cost::isImprovement(solution, bestCost))
 					break;
 				if(m_perturbType == PerturbType::Normal)
 				{
 					if (iterWithoutImprovement == m_stagnationAfter)
 					{
 						iterWithoutImprovement = 0;
-						auto str = std::max<size_t>(static_cast<size_t>(KeyboardSize * stagnationDistribution(m_randomGenerator)), 2);
+						auto str = std::max<size_t>(static_cast<size_t>(m_numLocations * detail::randomFloat(m_randomGenerator, m_minStagnationMagnitude, m_maxStagnationMagnitude)), 2);
 						perturbStr = std::max(str, perturbStr);
 					}
 					else if (hasImproved == true && prevLocalOptimum != currentKeyboard) // Escaped from the previous local optimum. New local optimum reached
 					{
 						iterWithoutImprovement++;
-						perturbStr = std::max<size_t>(static_cast<size_t>(std::ceil(m_jumpMagnitude * KeyboardSize)), 2);
+						perturbStr = std::max<size_t>(static_cast<size_t>(std::ceil(m_jumpMagnitude * m_numLocations)), 2);
 					}
 					else
 					{
@@ -368,7 +822,7 @@ protected:
 						prevLocalOptimum = currentKeyboard;
 						hasImproved = false;
 					}
-					perturbe(inOut(currentKeyboard), inOut(delta), inOut(currentCost), inOut(lastSwapped), iterWithoutImprovement, solution, perturbStr, inOut(iteration), objective);
+					perturbe(inOut(currentKeyboard), inOut(currentHash), inOut(delta), inOut(bestMove), searchState.get(), inOut(currentCost), inOut(lastSwapped), iterWithoutImprovement, solution, perturbStr, inOut(iteration), objective);
 				
 				}
 				else if (m_perturbType == PerturbType::Annealed)
@@ -376,7 +830,7 @@ protected:
 					if (hasImproved == true && prevLocalOptimum != currentKeyboard) // Escaped from the previous local optimum. New local optimum reached
 					{
 						iterWithoutImprovement++;
-						perturbStr = std::max<size_t>(static_cast<size_t>(std::ceil(m_jumpMagnitude * KeyboardSize)), 2);
+						perturbStr = std::max<size_t>(static_cast<size_t>(std::ceil(m_jumpMagnitude * m_numLocations)), 2);
 					}
 					else
 					{
@@ -387,14 +841,16 @@ protected:
 					{
 						prevLocalOptimum = currentKeyboard;
 					}
-					annealed_perturbe(inOut(currentKeyboard), inOut(delta), inOut(currentCost), inOut(lastSwapped), iterWithoutImprovement, solution, perturbStr, inOut(iteration), objective);
+					annealed_perturbe(inOut(currentKeyboard), inOut(currentHash), inOut(delta), inOut(bestMove), searchState.get(), inOut(currentCost), inOut(lastSwapped), iterWithoutImprovement, solution, perturbStr, inOut(iteration), objective);
 
 				}
 
-				if (currentCost > solution + tolerance)
+				if (Cost::isImprovement(currentCost, solution))
 				{
 					solution = currentCost;
 					keyboard = currentKeyboard;
+					hash = currentHash;
+					workspace.m_bestPending = true;
 				}
 				hasImproved = false;
 			}
@@ -403,31 +859,214 @@ protected:
 				break;
 			}
 		};
-		return std::make_tuple(keyboard, solution);
+		cacheDeltas(keyboard, solution, hash, delta, bestMove);
+		return std::make_tuple(keyboard, solution, hash);
 	}
 
+	// The first improvement descent of DescentType::FirstImprovement, which makes at most maxMoves moves. Returns the
+	// number of moves made. Every move evaluation consumes one evaluation, like one element of a delta matrix
 	template<typename Objective>
-	void computeAllDeltas(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution, const Objective& objective, InOut<DeltaArray> delta, size_t from = Objective::NoSwap, size_t to = Objective::NoSwap)
+	size_t firstImprovementDescent(InOut<Keyboard<KeyboardSize>> keyboard, InOut<FloatingPoint> solution, InOut<uint64_t> hash, size_t maxMoves, InOut<SwapStampArray> lastSwapped,
+		typename Objective::SearchState* searchState, const Objective& objective)
 	{
-		objective.evaluateNeighbourhood(keyboard, solution, from, to, delta);
-		m_numEvaluationsLeft-= KeyboardSize * (KeyboardSize - 1) / 2;
-		if (m_snapshotEvery != 0)
+		auto& dontLook = m_workspace.get().m_dontLook;
+		dontLook.fill(false);
+		size_t lastSwapI = Objective::NoSwap;
+		size_t lastSwapJ = Objective::NoSwap;
+		size_t numMoves = 0;
+		bool improved = true;
+		for (size_t pass = 0; improved && pass < m_firstImprovementPasses; pass++)
 		{
-			size_t evaluations = m_totalEvaluations - m_numEvaluationsLeft;
-			if (m_snapshots.empty())
+			improved = false;
+			for (size_t i = 0; i < m_numLocations && numMoves < maxMoves && !m_budget.exhausted(std::get<0>(m_bestSolution)); i++)
 			{
-				if (evaluations >= m_snapshotEvery)
+				if (dontLook[i])
 				{
-					updateBestSolution();
-					m_snapshots.emplace_back(std::make_pair(m_bestSolution, evaluations));
+					continue;
+				}
+				size_t j = 0;
+				for (; j < m_numLocations; j++)
+				{
+					if (j == i)
+					{
+						continue;
+					}
+					const size_t from = std::min(i, j);
+					const size_t to = std::max(i, j);
+					const FloatingPoint d = objective.evaluateMove(keyboard.get(), solution.get(), lastSwapI, lastSwapJ, from, to, searchState);
+					lastSwapI = Objective::NoSwap;
+					lastSwapJ = Objective::NoSwap;
+					m_budget.consume(1);
+					m_instrumentation.count(InstrumentationCounter::MoveEvaluations);
+					if (d > 0)
+					{
+						m_instrumentation.count(InstrumentationCounter::Iterations);
+						m_instrumentation.count(InstrumentationCounter::ImprovingMoves);
+						hash = keyboard.get().swappedHash(hash, from, to);
+						std::swap(keyboard.get().m_keys[from], keyboard.get().m_keys[to]);
+						solution = solution.get() + d;
+						lastSwapped.get()[pairIndex(from, to)] = static_cast<uint32_t>(numMoves);
+						lastSwapI = from;
+						lastSwapJ = to;
+						dontLook[j] = false;
+						numMoves++;
+						improved = true;
+						break;
+					}
 				}
+				if (j == m_numLocations)
+				{
+					dontLook[i] = true;
+				}
+			}
+		}
+		return numMoves;
+	}
+
+	// Robust tabu search (Taillard). Every iteration makes the best move that isn't tabu, or that leads to a new best
+	// solution, unless a move has been allowed for so long that it's forced. A move is tabu when both keys would return to positions that they have left within their tenure.
+	// The tenure is drawn once per move, and stored as the iteration when the key may return to the position.
+	template<typename Objective>
+	Candidate robustTabuSearch(Keyboard<KeyboardSize> keyboard, FloatingPoint solution, uint64_t hash, size_t numIterations, bool steepestAscentOnly, const Objective& objective)
+	{
+		Keyboard<KeyboardSize> currentKeyboard = keyboard;
+		uint64_t currentHash = hash;
+		FloatingPoint currentCost = solution;
+		const FloatingPoint initialCost = solution;
+		Workspace& workspace = m_workspace.get();
+		DeltaArray& delta = workspace.m_delta;
+		ExpiryArray& tabu = workspace.m_tabu;
+		Move bestMove;
+		auto searchState = objective.createSearchState();
+		for (auto&& row : tabu)
+		{
+			row.fill(0);
+		}
+		initialDeltas(currentKeyboard, currentCost, hash, objective, inOut(delta), inOut(bestMove), searchState.get());
+
+		const float minTenure = m_minTabuTenureDist * m_numLocations;
+		const float maxTenure = m_maxTabuTenureDist * m_numLocations;
+		for (uint32_t iteration = 1; iteration <= numIterations && !m_budget.exhausted(std::get<0>(m_bestSolution)); iteration++)
+		{
+			if (m_primarilyEvolution && !steepestAscentOnly && std::get<2>(bestMove) <= 0 && !Cost::isImprovement(solution, initialCost))
+			{
+				break;
+			}
+			size_t iRetained;
+			size_t jRetained;
+			std::tie(iRetained, jRetained) = robustTabuMove(delta, bestMove, tabu, currentKeyboard, iteration, currentCost, solution);
+			m_instrumentation.count(InstrumentationCounter::Iterations);
+			if (delta[iRetained][jRetained] > 0)
+			{
+				m_instrumentation.count(InstrumentationCounter::ImprovingMoves);
 			}
-			else if (evaluations - m_snapshots.back().second >= m_snapshotEvery)
+
+			const uint32_t expiry = iteration + static_cast<uint32_t>(detail::randomFloat(m_randomGenerator, minTenure, maxTenure));
+			tabu[iRetained][currentKeyboard.m_keys[iRetained]] = expiry;
+			tabu[jRetained][currentKeyboard.m_keys[jRetained]] = expiry;
+			currentCost = applySwap(iRetained, jRetained, inOut(currentKeyboard), inOut(currentHash), currentCost, inOut(delta), inOut(bestMove), searchState.get(), objective);
+			if (Cost::isImprovement(currentCost, solution))
 			{
-				updateBestSolution();
-				m_snapshots.emplace_back(std::make_pair(m_bestSolution, evaluations));
+				solution = currentCost;
+				keyboard = currentKeyboard;
+				hash = currentHash;
+				workspace.m_bestPending = true;
+			}
+		}
+		cacheDeltas(keyboard, solution, hash, delta, bestMove);
+		return std::make_tuple(keyboard, solution, hash);
+	}
+
+	// The move of the robust tabu search. The admissibility and the aspiration are checked in the same pass as the
+	// best move is searched. A move is aspired when it leads to a new best solution, or when one of the keys would
+	// return to a position where its tabu expired more than aspirationAge() iterations ago. The best aspired move is
+	// made before any other, which diversifies the search, and otherwise the best admissible move.
+	std::tuple<size_t, size_t> robustTabuMove(const DeltaArray& delta, const Move& bestMove, const ExpiryArray& tabu, const Keyboard<KeyboardSize>& keyboard,
+		uint32_t iteration, FloatingPoint currentCost, FloatingPoint bestCost) const
+	{
+		const FloatingPoint aspiration = Cost::improvementThreshold(bestCost);
+		const auto& keys = keyboard.m_keys;
+		const int64_t forcedBefore = static_cast<int64_t>(iteration) - static_cast<int64_t>(aspirationAge());
+		// When every move is tabu, the best move is made anyway
+		size_t iRetained = std::get<0>(bestMove);
+		size_t jRetained = std::get<1>(bestMove);
+		FloatingPoint maxDelta = std::numeric_limits<FloatingPoint>::lowest();
+		bool aspiredRetained = false;
+		for (size_t i = 0; i < m_numLocations; i++)
+		{
+			const FloatingPoint* row = delta[i].data();
+			const uint32_t* tabuI = tabu[i].data();
+			for (size_t j = i + 1; j < m_numLocations; j++)
+			{
+				const uint32_t expiryI = tabuI[keys[j]];
+				const uint32_t expiryJ = tabu[j][keys[i]];
+				const FloatingPoint d = row[j];
+				const bool aspired = static_cast<int64_t>(expiryI) < forcedBefore || static_cast<int64_t>(expiryJ) < forcedBefore || currentCost + d > aspiration;
+				const bool admissible = expiryI < iteration || expiryJ < iteration;
+				if ((aspired && !aspiredRetained) || (aspired == aspiredRetained && d > maxDelta && (aspired || admissible)))
+				{
+					iRetained = i;
+					jRetained = j;
+					maxDelta = d;
+					aspiredRetained = aspired;
+				}
 			}
 		}
+		return std::make_tuple(iRetained, jRetained);
+	}
+
+	// The delta matrix the local search starts with. A cached matrix is brought up to date by replaying its swaps, which
+	// gives the same matrix as a rebuild with exact costs, and the evaluations of a full rebuild are consumed anyway,
+	// so that the cache doesn't change the course of the run
+	template<typename Objective>
+	void initialDeltas(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution, uint64_t hash, const Objective& objective, InOut<DeltaArray> delta, InOut<Move> bestMove,
+		typename Objective::SearchState* searchState)
+	{
+		ScopedPhase phase(m_instrumentation, InstrumentationPhase::InitialDeltas);
+		m_workspace.get().m_bestPending = true;
+		const typename DeltaCache::Entry* entry = m_deltaCache.enabled() ? m_deltaCache.find(keyboard, hash) : nullptr;
+		if (!entry)
+		{
+			computeAllDeltas(keyboard, solution, objective, inOut(delta), inOut(bestMove), searchState);
+			return;
+		}
+		m_instrumentation.count(InstrumentationCounter::DeltaCacheHits);
+		delta = entry->m_delta;
+		bestMove = entry->m_bestMove;
+		Keyboard<KeyboardSize> current = entry->m_base;
+		FloatingPoint cost = entry->m_baseCost;
+		for (auto&& swap : entry->m_swaps)
+		{
+			std::swap(current.m_keys[swap.first], current.m_keys[swap.second]);
+			cost += delta.get()[swap.first][swap.second];
+			bestMove = objective.evaluateNeighbourhoodBestMove(current, cost, swap.first, swap.second, delta.get(), searchState);
+		}
+		m_budget.consume(neighbourhoodSize());
+	}
+
+	// Stores the delta matrix of the best keyboard of a local search at the end of the search
+	void cacheDeltas(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution, uint64_t hash, const DeltaArray& currentDelta, const Move& currentBestMove)
+	{
+		if (!m_deltaCache.enabled())
+		{
+			return;
+		}
+		const Workspace& workspace = m_workspace.get();
+		auto& entry = m_deltaCache.insert(keyboard, hash);
+		entry.m_base = keyboard;
+		entry.m_baseCost = solution;
+		entry.m_delta = workspace.m_bestPending ? currentDelta : workspace.m_bestDelta;
+		entry.m_bestMove = workspace.m_bestPending ? currentBestMove : workspace.m_bestMove;
+		entry.m_swaps.clear();
+	}
+
+	template<typename Objective>
+	void computeAllDeltas(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution, const Objective& objective, InOut<DeltaArray> delta, InOut<Move> bestMove,
+		typename Objective::SearchState* searchState, size_t from = Objective::NoSwap, size_t to = Objective::NoSwap)
+	{
+		m_instrumentation.count(from == Objective::NoSwap ? InstrumentationCounter::FullDeltaBuilds : InstrumentationCounter::PartialDeltaUpdates);
+		bestMove = objective.evaluateNeighbourhoodBestMove(keyboard, solution, from, to, delta, searchState);
+		m_budget.consume(neighbourhoodSize());
 	}
 
 	void updateBestSolution()
@@ -442,12 +1081,10 @@ protected:
 	}
 
 	template<typename Objective>
-	void perturbe(InOut<Keyboard<KeyboardSize>> currentKeyboard, InOut<DeltaArray> delta, InOut<FloatingPoint> currentCost,
-		InOut<IndexArray> lastSwapped, size_t iterWithoutImprovement, FloatingPoint bestBestCost, size_t perturbStr, InOut<size_t> iteration, const Objective& objective)
+	void perturbe(InOut<Keyboard<KeyboardSize>> currentKeyboard, InOut<uint64_t> currentHash, InOut<DeltaArray> delta, InOut<Move> bestMove, typename Objective::SearchState* searchState, InOut<FloatingPoint> currentCost,
+		InOut<SwapStampArray> lastSwapped, size_t iterWithoutImprovement, FloatingPoint bestBestCost, size_t perturbStr, InOut<size_t> iteration, const Objective& objective)
 	{
-		std::uniform_real_distribution<float> dist(0.0f, std::nextafter(1.0f, 2.0f));
-		std::uniform_real_distribution<float> tenureDist(m_minTabuTenureDist, m_maxTabuTenureDist);
-		std::uniform_int_distribution<int> keyDist(0, KeyboardSize - 1);
+		ScopedPhase phase(m_instrumentation, InstrumentationPhase::Perturbation);
 		const float d = static_cast<float>(iterWithoutImprovement) / m_stagnationAfter;
 		for (size_t k = 0; k < perturbStr; k++)
 		{
@@ -455,24 +1092,26 @@ protected:
 			float e = std::exp(-d * m_minDirectedPerturbation);
 			//e = std::max(m_minDirectedPerturbation, e);
 
-			if (e > dist(m_randomGenerator))
+			if (e > detail::randomFloat(m_randomGenerator))
 				useTabu = true;
 
 			size_t iRetained;
 			size_t jRetained;
 			if (useTabu)
 			{
-				std::tie(iRetained, jRetained) = tabuPerturbe(delta, lastSwapped, tenureDist, iteration, currentCost, bestBestCost);
+				m_instrumentation.count(InstrumentationCounter::TabuPerturbations);
+				std::tie(iRetained, jRetained) = tabuPerturbe(delta, bestMove, lastSwapped, iteration, currentCost, bestBestCost);
 			}
 			else
 			{
-				std::tie(iRetained, jRetained) = randomPerturbe(keyDist);
+				m_instrumentation.count(InstrumentationCounter::RandomPerturbations);
+				std::tie(iRetained, jRetained) = randomPerturbe();
 			}
 
 			if (iRetained != std::numeric_limits<size_t>::max())
 			{
-				currentCost = swapKeys(iRetained, jRetained, inOut(currentKeyboard), currentCost, inOut(delta), iteration, inOut(lastSwapped), objective);
-				if (currentCost > bestBestCost + tolerance)
+				currentCost = swapKeys(iRetained, jRetained, inOut(currentKeyboard), inOut(currentHash), currentCost, inOut(delta), inOut(bestMove), searchState, iteration, inOut(lastSwapped), objective);
+				if (Cost::isImprovement(currentCost, bestBestCost))
 				{
 					bestBestCost = currentCost;
 					iteration++;
@@ -483,44 +1122,31 @@ protected:
 		}
 	}
 
-	std::tuple<size_t, size_t, FloatingPoint> steepestAscent(const DeltaArray delta)
+	std::tuple<size_t, size_t> tabuPerturbe(const DeltaArray& delta, const Move& bestMove, const SwapStampArray& lastSwapped, size_t iteration, FloatingPoint currentCost, FloatingPoint bestBestCost)
 	{
-		size_t iRetained = std::numeric_limits<size_t>::max();
-		size_t jRetained = iRetained;
-		FloatingPoint maxDelta = std::numeric_limits<FloatingPoint>::lowest();
-		for (size_t i = 0; i < KeyboardSize; i++)
+		const FloatingPoint aspiration = Cost::improvementThreshold(bestBestCost);
+		// The best move is always admissible when it satisfies the aspiration criterion, so the scan can be skipped
+		if (currentCost + std::get<2>(bestMove) > aspiration)
 		{
-			for (size_t j = i + 1; j < KeyboardSize; j++)
-			{
-				FloatingPoint d = delta[i][j];
-				if (d > maxDelta)
-				{
-					maxDelta = d;
-					iRetained = i;
-					jRetained = j;
-				}
-			}
+			return std::make_tuple(std::get<0>(bestMove), std::get<1>(bestMove));
 		}
-		return std::make_tuple(iRetained, jRetained, maxDelta);
-	}
-
-	std::tuple<size_t, size_t> tabuPerturbe(const DeltaArray& delta, const IndexArray& lastSwapped, const std::uniform_real_distribution<float>& tabuTenureDist, size_t iteration, FloatingPoint currentCost, FloatingPoint bestBestCost)
-	{
 		size_t iRetained = std::numeric_limits<size_t>::max();
 		size_t jRetained = iRetained;
 		FloatingPoint maxDelta = std::numeric_limits<FloatingPoint>::lowest();
-		for (size_t i = 0; i < KeyboardSize; i++)
+		for (size_t i = 0; i < m_numLocations; i++)
 		{
-			for (size_t j = i + 1; j < KeyboardSize; j++)
+			const FloatingPoint* row = delta[i].data();
+			const uint32_t* swapped = lastSwapped.data() + pairIndex(i, i + 1);
+			for (size_t j = i + 1; j < m_numLocations; j++)
 			{
-				FloatingPoint d = delta[i][j];
+				FloatingPoint d = row[j];
 				if (d > maxDelta)
 				{
-					if ((lastSwapped[i][j] + std::pow(tabuTenureDist(m_randomGenerator), 3.0f) * KeyboardSize) < iteration || (currentCost + delta[i][j]) > bestBestCost + tolerance)
+					if ((swapped[j - i - 1] + std::pow(detail::randomFloat(m_randomGenerator, m_minTabuTenureDist, m_maxTabuTenureDist), 3.0f) * m_numLocations) < iteration || (currentCost + d) > aspiration)
 					{
 						iRetained = i;
 						jRetained = j;
-						maxDelta = delta[i][j];
+						maxDelta = d;
 					}
 				}
 			}
@@ -528,13 +1154,13 @@ protected:
 		return std::make_tuple(iRetained, jRetained);
 	}
 
-	std::tuple<size_t, size_t> randomPerturbe(const std::uniform_int_distribution<int>& keyDist)
+	std::tuple<size_t, size_t> randomPerturbe()
 	{
-		size_t iRetained = keyDist(m_randomGenerator);
-		size_t jRetained = keyDist(m_randomGenerator);
+		size_t iRetained = detail::randomIndex(m_randomGenerator, m_numLocations);
+		size_t jRetained = detail::randomIndex(m_randomGenerator, m_numLocations);
 		while (iRetained == jRetained)
 		{
-			jRetained = keyDist(m_randomGenerator);
+			jRetained = detail::randomIndex(m_randomGenerator, m_numLocations);
 		}
 		if (iRetained > jRetained)
 			std::swap(iRetained, jRetained);
@@ -542,12 +1168,11 @@ protected:
 	}
 
 	template<typename Objective>
-	void annealed_perturbe(InOut<Keyboard<KeyboardSize>> currentKeyboard, InOut<DeltaArray> delta, InOut<FloatingPoint> currentCost,
-		InOut<IndexArray> lastSwapped, size_t iterWithoutImprovement, FloatingPoint bestBestCost, size_t perturbStr, InOut<size_t> iteration, const Objective& objective)
+	void annealed_perturbe(InOut<Keyboard<KeyboardSize>> currentKeyboard, InOut<uint64_t> currentHash, InOut<DeltaArray> delta, InOut<Move> bestMove, typename Objective::SearchState* searchState, InOut<FloatingPoint> currentCost,
+		InOut<SwapStampArray> lastSwapped, size_t iterWithoutImprovement, FloatingPoint bestBestCost, size_t perturbStr, InOut<size_t> iteration, const Objective& objective)
 	{
-		std::uniform_real_distribution<float> tabuTenureDist(m_minTabuTenureDist, m_maxTabuTenureDist);
-		std::array<std::array<bool, KeyboardSize>, KeyboardSize> valid;
-		auto probability = std::uniform_real_distribution<float>(0, 1.0);
+		ScopedPhase phase(m_instrumentation, InstrumentationPhase::Perturbation);
+		auto& valid = m_workspace.get().m_valid;
 		float min_t = m_minT;
 		float d = static_cast<float>(iterWithoutImprovement) / m_stagnationAfter;
 		const float fiftyPercent = 1.0f / std::log(2.0f);
@@ -560,11 +1185,11 @@ protected:
 		{
 			size_t iRetained = std::numeric_limits<size_t>::max();
 			size_t jRetained = iRetained;
-			FloatingPoint maxDelta = std::numeric_limits<float>::lowest();
-			FloatingPoint minDelta = std::numeric_limits<float>::max();
-			for (size_t i = 0; i < KeyboardSize; i++)
+			FloatingPoint maxDelta = std::numeric_limits<FloatingPoint>::lowest();
+			FloatingPoint minDelta = std::numeric_limits<FloatingPoint>::max();
+			for (size_t i = 0; i < m_numLocations; i++)
 			{
-				for (size_t j = i + 1; j < KeyboardSize; j++)
+				for (size_t j = i + 1; j < m_numLocations; j++)
 				{
 					valid[i][j] = false;
 					if (currentCost + delta.get()[i][j] > bestBestCost)
@@ -573,7 +1198,7 @@ protected:
 						jRetained = j;
 						break;
 					}
-					if ((lastSwapped.get()[i][j] + tabuTenureDist(m_randomGenerator) * KeyboardSize) < iteration)
+					if ((lastSwapped.get()[pairIndex(i, j)] + detail::randomFloat(m_randomGenerator, m_minTabuTenureDist, m_maxTabuTenureDist) * m_numLocations) < iteration)
 					{
 						if (delta.get()[i][j] > maxDelta)
 						{
@@ -597,19 +1222,19 @@ protected:
 				std::array<size_t, KeyboardSize> b;
 				std::iota(a.begin(), a.end(), 0);
 				std::iota(b.begin(), b.end(), 0);
-				std::shuffle(a.begin(), a.end(), m_randomGenerator);
-				std::shuffle(b.begin(), b.end(), m_randomGenerator);
+				detail::shuffle(a.begin(), a.begin() + m_numLocations, m_randomGenerator);
+				detail::shuffle(b.begin(), b.begin() + m_numLocations, m_randomGenerator);
 
-				float p = probability(m_randomGenerator);
+				float p = detail::randomFloat(m_randomGenerator);
 				float m = std::numeric_limits<float>::max();
 				if (p > 0.0 && p <= 1.0f)
 				{
 					m = currentT * std::log(1.0f / p);
 				}
 
-				for (size_t i = 0; i < KeyboardSize; i++)
+				for (size_t i = 0; i < m_numLocations; i++)
 				{
-					for (size_t j = 0; j < KeyboardSize; j++)
+					for (size_t j = 0; j < m_numLocations; j++)
 					{
 						auto ai = a[i];
 						auto bj = b[j];
@@ -619,7 +1244,7 @@ protected:
 
 							if (valid[ai][bj])
 							{
-								FloatingPoint v = (maxDelta - d) / (maxDelta - minDelta);
+								auto v = static_cast<typename Cost::Real>(maxDelta - d) / static_cast<typename Cost::Real>(maxDelta - minDelta);
 								if (v < m)
 								{
 									iRetained = ai;
@@ -637,7 +1262,7 @@ protected:
 			}
 			if (iRetained != std::numeric_limits<size_t>::max())
 			{
-				currentCost = swapKeys(iRetained, jRetained, inOut(currentKeyboard), currentCost, inOut(delta), iteration, inOut(lastSwapped), objective);
+				currentCost = swapKeys(iRetained, jRetained, inOut(currentKeyboard), inOut(currentHash), currentCost, inOut(delta), inOut(bestMove), searchState, iteration, inOut(lastSwapped), objective);
 				if (currentCost > bestBestCost)
 				{
 					bestBestCost = currentCost;
@@ -652,15 +1277,88 @@ protected:
 	}
 
 	template<typename Objective>
-	FloatingPoint swapKeys(size_t from, size_t to, InOut<Keyboard<KeyboardSize>> currentKeyboard, FloatingPoint currentCost, InOut<DeltaArray> delta, size_t iteration, InOut<IndexArray> lastSwapped, const Objective& objective)
+	FloatingPoint swapKeys(size_t from, size_t to, InOut<Keyboard<KeyboardSize>> currentKeyboard, InOut<uint64_t> currentHash, FloatingPoint currentCost, InOut<DeltaArray> delta, InOut<Move> bestMove,
+		typename Objective::SearchState* searchState, size_t iteration, InOut<SwapStampArray> lastSwapped, const Objective& objective)
 	{
-		lastSwapped.get()[from][to] = iteration;
+		// The moves are always from < to
+		lastSwapped.get()[pairIndex(from, to)] = static_cast<uint32_t>(iteration);
+		return applySwap(from, to, inOut(currentKeyboard), inOut(currentHash), currentCost, inOut(delta), inOut(bestMove), searchState, objective);
+	}
+
+	template<typename Objective>
+	FloatingPoint applySwap(size_t from, size_t to, InOut<Keyboard<KeyboardSize>> currentKeyboard, InOut<uint64_t> currentHash, FloatingPoint currentCost, InOut<DeltaArray> delta, InOut<Move> bestMove,
+		typename Objective::SearchState* searchState, const Objective& objective)
+	{
+		currentHash = currentKeyboard.get().swappedHash(currentHash, from, to);
 		std::swap(currentKeyboard.get().m_keys[from], currentKeyboard.get().m_keys[to]);
 		FloatingPoint newCost = currentCost + delta.get()[from][to];
-		computeAllDeltas(currentKeyboard, newCost, objective, inOut(delta), from, to);
+		if (m_deltaCache.enabled())
+		{
+			// A swap that improves on the best keyboard leads to the next best keyboard, so the matrix is only copied
+			// once per local optimum
+			Workspace& workspace = m_workspace.get();
+			if (workspace.m_bestPending && !Cost::isImprovement(newCost, currentCost))
+			{
+				workspace.m_bestDelta = delta.get();
+				workspace.m_bestMove = bestMove.get();
+				workspace.m_bestPending = false;
+			}
+		}
+		computeAllDeltas(currentKeyboard, newCost, objective, inOut(delta), inOut(bestMove), searchState, from, to);
 		return newCost;
 	}
 
+	// Gives the child the cached matrix of the closer parent when the child is only a few swaps away from it, so that
+	// the local search of the child replays the swaps instead of rebuilding the matrix
+	void deriveChildDeltas(const Keyboard<KeyboardSize>& child, uint64_t childHash, std::pair<size_t, size_t> parents, DeltaCache& cache)
+	{
+		if (cache.find(child, childHash))
+		{
+			return;
+		}
+		Workspace& workspace = m_workspace.get();
+		typename DeltaCache::Entry* source = nullptr;
+		// The number of swaps to replay
+		size_t replayLength = DeltaCache::MaxSwaps + 1;
+		for (size_t parent : { parents.first, parents.second })
+		{
+			auto* entry = findCachedDeltas(m_population[parent], m_populationHashes[parent]);
+			if (entry && entry->m_swaps.size() < replayLength &&
+				detail::swapSequence(m_population[parent], child, replayLength - 1 - entry->m_swaps.size(), workspace.m_otherSwaps))
+			{
+				source = entry;
+				replayLength = entry->m_swaps.size() + workspace.m_otherSwaps.size();
+				std::swap(workspace.m_swaps, workspace.m_otherSwaps);
+			}
+		}
+		if (!source)
+		{
+			return;
+		}
+		auto& entry = cache.insert(child, childHash);
+		// The oldest entry of the cache can be the one of the parent, which then continues as the entry of the child
+		if (&entry != source)
+		{
+			entry.m_base = source->m_base;
+			entry.m_baseCost = source->m_baseCost;
+			entry.m_delta = source->m_delta;
+			entry.m_bestMove = source->m_bestMove;
+			entry.m_swaps = source->m_swaps;
+		}
+		entry.m_swaps.insert(entry.m_swaps.end(), workspace.m_swaps.begin(), workspace.m_swaps.end());
+	}
+
+	// The workers keep the matrices of the keyboards they have searched in caches of their own
+	typename DeltaCache::Entry* findCachedDeltas(const Keyboard<KeyboardSize>& keyboard, uint64_t hash)
+	{
+		auto* entry = m_deltaCache.find(keyboard, hash);
+		for (size_t i = 0; !entry && i < m_workers.size(); i++)
+		{
+			entry = m_workers[i].m_deltaCache.find(keyboard, hash);
+		}
+		return entry;
+	}
+
 	std::pair<size_t, size_t> parentSelection()
 	{
 		const size_t numParents = 2;
@@ -674,8 +1372,7 @@ protected:
 		{
 			bool insert = true;
 			std::array<size_t, maxTournamentSize> tournamentPool;
-			std::uniform_int_distribution<size_t> gen(0, m_populationSize - 1);
-			std::generate_n(tournamentPool.begin(), tournamentSize, [this, &gen]() { return gen(m_randomGenerator); });
+			std::generate_n(tournamentPool.begin(), tournamentSize, [this]() { return detail::randomIndex(m_randomGenerator, m_populationSize); });
 
 			FloatingPoint m = std::numeric_limits<FloatingPoint>::lowest();
 			size_t winner;
@@ -705,11 +1402,11 @@ protected:
 
 	Keyboard<KeyboardSize> produceChild(const Keyboard<KeyboardSize>& parent1, const Keyboard<KeyboardSize>& parent2)
 	{
+		ScopedPhase phase(m_instrumentation, InstrumentationPhase::Crossover);
 		if (m_crossoverType == CrossoverType::PartiallyMatched)
 		{
-			auto dist = std::uniform_int_distribution<size_t>(0, parent1.m_keys.size() - 1);
-			auto p1 = dist(m_randomGenerator);
-			auto p2 = dist(m_randomGenerator);
+			auto p1 = detail::randomIndex(m_randomGenerator, m_numLocations);
+			auto p2 = detail::randomIndex(m_randomGenerator, m_numLocations);
 			if (p2 < p1)
 			{
 				std::swap(p1, p2);
@@ -722,10 +1419,11 @@ protected:
 		}
 	}
 
-	void replaceSolution(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution)
+	void replaceSolution(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution, uint64_t hash)
 	{
-		if (std::find(m_population.begin(), m_population.end(), keyboard) != m_population.end())
+		if (inPopulation(keyboard, hash))
 		{
+			m_instrumentation.count(InstrumentationCounter::DuplicateRejections);
 			return;
 		}
 
@@ -738,9 +1436,78 @@ protected:
 		{
 			m_bestSolution = std::make_tuple(solution, keyboard);
 		}
-		std::swap(*worst, solution);
 		size_t index = worst - m_populationSolutions.begin();
-		m_population[index] = keyboard;
+		if (m_replacementType == ReplacementType::QualityAndDistance)
+		{
+			index = lowestGoodnessScore(keyboard, solution);
+			if (index == NotReplaced)
+			{
+				return;
+			}
+		}
+		setPopulationMember(index, keyboard, solution, hash);
+	}
+
+	static constexpr size_t NotReplaced = std::numeric_limits<size_t>::max();
+
+	// The pool updating of Benlic and Hao. The child joins the population, and the member with the lowest goodness score
+	// leaves it. The score is qualityWeight * quality + (1 - qualityWeight) * distance, where the quality is the cost and
+	// the distance is the distance to the closest other member, both normalized to [0, 1] over the population and the child.
+	// When the child itself scores lowest, it replaces the second lowest member with m_secondWorstProbability
+	size_t lowestGoodnessScore(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution)
+	{
+		const size_t size = m_population.size();
+		// The child is the last one
+		std::vector<size_t> closest(size + 1, std::numeric_limits<size_t>::max());
+		for (size_t i = 0; i < size; i++)
+		{
+			const size_t d = keyboard.distance(m_population[i]);
+			closest[size] = std::min(closest[size], d);
+			closest[i] = d;
+			const uint32_t* row = m_populationDistances.data() + i * size;
+			for (size_t j = 0; j < size; j++)
+			{
+				if (j != i)
+				{
+					closest[i] = std::min<size_t>(closest[i], row[j]);
+				}
+			}
+		}
+		auto cost = [this, size, solution](size_t i) { return i < size ? m_populationSolutions[i] : solution; };
+		FloatingPoint minCost = solution;
+		FloatingPoint maxCost = solution;
+		const auto distanceRange = std::minmax_element(closest.begin(), closest.end());
+		for (size_t i = 0; i < size; i++)
+		{
+			minCost = std::min(minCost, m_populationSolutions[i]);
+			maxCost = std::max(maxCost, m_populationSolutions[i]);
+		}
+		auto normalize = [](double v, double min, double max) { return max > min ? (v - min) / (max - min) : 0.0; };
+		std::vector<double> scores(size + 1);
+		for (size_t i = 0; i <= size; i++)
+		{
+			scores[i] = m_qualityWeight * normalize(static_cast<double>(cost(i)), static_cast<double>(minCost), static_cast<double>(maxCost)) +
+				(1.0 - m_qualityWeight) * normalize(static_cast<double>(closest[i]), static_cast<double>(*distanceRange.first), static_cast<double>(*distanceRange.second));
+		}
+		size_t lowest = 0;
+		size_t secondLowest = NotReplaced;
+		for (size_t i = 1; i <= size; i++)
+		{
+			if (scores[i] < scores[lowest])
+			{
+				secondLowest = lowest;
+				lowest = i;
+			}
+			else if (secondLowest == NotReplaced || scores[i] < scores[secondLowest])
+			{
+				secondLowest = i;
+			}
+		}
+		if (lowest < size)
+		{
+			return lowest;
+		}
+		return detail::randomFloat(m_randomGenerator) < m_secondWorstProbability ? secondLowest : NotReplaced;
 	}
 
 	bool populationIsUnique() const
@@ -763,72 +1530,226 @@ protected:
 
 	void mutatePopulation(size_t mutationStrength)
 	{
+		// The cached matrices of the members follow the mutations when the swaps are few enough to replay
+		const bool updateCache = m_deltaCache.enabled() && mutationStrength - 1 <= DeltaCache::MaxSwaps;
+		auto& swaps = m_workspace.get().m_swaps;
 		for (int i = 0; i < m_populationSize; i++)
 		{
+			const Keyboard<KeyboardSize> original = m_population[i];
+			swaps.clear();
 			std::array<int, KeyboardSize> indices;
 			std::iota(indices.begin(), indices.end(), 0);
-			std::shuffle(indices.begin(), indices.end(), m_randomGenerator);
+			detail::shuffle(indices.begin(), indices.begin() + m_numLocations, m_randomGenerator);
 			for (int j = 0; j < mutationStrength - 1; j++)
 			{
 				std::swap(m_population[i].m_keys[indices[j]], m_population[i].m_keys[indices[j + 1]]);
+				if (updateCache)
+				{
+					swaps.emplace_back(static_cast<uint16_t>(std::min(indices[j], indices[j + 1])), static_cast<uint16_t>(std::max(indices[j], indices[j + 1])));
+				}
+			}
+			if (updateCache)
+			{
+				// The workers search the same members in every generation, so their caches are updated too
+				const uint64_t hash = m_population[i].hash();
+				m_deltaCache.extend(original, m_populationHashes[i], m_population[i], hash, swaps);
+				for (auto&& worker : m_workers)
+				{
+					worker.m_deltaCache.extend(original, m_populationHashes[i], m_population[i], hash, swaps);
+				}
 			}
 		}
+		rebuildPopulationIndex();
 	}
 
 	void updateEliteArchive()
 	{
 		for (size_t i = 0; i < m_population.size(); i++)
 		{
-			auto& keyboard = m_population[i];
-			FloatingPoint solution = m_populationSolutions[i];
-			updateEliteArchive(keyboard, solution);
+			updateEliteArchive(m_population[i], m_populationSolutions[i], m_populationHashes[i]);
 		}
 	}
 
-	void updateEliteArchive(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution)
+	void updateEliteArchive(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution, uint64_t hash)
 	{
-		Elite e(keyboard, solution);
-		if (m_eliteSoFar.find(e) == m_eliteSoFar.end())
+		auto equal = [this, &keyboard](size_t i) { return m_elites[i].m_keyboard == keyboard; };
+		if (m_eliteIndex.find(hash, equal) != detail::HashIndex::NotFound)
+		{
+			return;
+		}
+		if (m_elites.size() < m_eliteCapacity)
 		{
-			m_eliteSoFar.insert(e);
+			m_eliteIndex.insert(hash, m_elites.size());
+			m_elites.emplace_back(keyboard, solution, hash);
+			return;
+		}
+		const size_t minDistance = static_cast<size_t>(m_eliteMinDistance * m_numLocations);
+		size_t worst = 0;
+		size_t closest = 0;
+		size_t closestDistance = std::numeric_limits<size_t>::max();
+		for (size_t i = 0; i < m_elites.size(); i++)
+		{
+			if (CompareElite()(m_elites[i], m_elites[worst]))
+			{
+				worst = i;
+			}
+			if (minDistance > 0)
+			{
+				const size_t d = keyboard.distance(m_elites[i].m_keyboard);
+				if (d < closestDistance)
+				{
+					closest = i;
+					closestDistance = d;
+				}
+			}
+		}
+		const size_t replaced = closestDistance < minDistance ? closest : worst;
+		if (solution > m_elites[replaced].m_solution)
+		{
+			m_eliteIndex.erase(m_elites[replaced].m_hash, replaced);
+			m_elites[replaced] = Elite(keyboard, solution, hash);
+			m_eliteIndex.insert(hash, replaced);
 		}
 	}
 
-	void startTimer()
+	bool stopRequested() const
 	{
-		m_startTime = getCurrentProcessTime();
+		return m_stop && m_stop->load(std::memory_order_relaxed);
 	}
 
-	double getCurrentTime() const
+	// The checkpoints are only read by the same build, so the arrays are written as they are in memory
+	struct CheckpointHeader
 	{
-		return getCurrentProcessTime() - m_startTime;
+		char m_magic[8];
+		uint32_t m_version;
+		uint32_t m_keyboardSize;
+		uint32_t m_costSize;
+		uint32_t m_randomGeneratorSize;
+		uint32_t m_numWorkers;
+		uint64_t m_populationSize;
+		uint64_t m_numElites;
+		uint64_t m_evaluationsUsed;
+		double m_wallTime;
+		double m_cpuTime;
+		double m_timeOfBest;
+		uint64_t m_numWithoutImprovement;
+		uint64_t m_numMutations;
+		static const uint32_t CurrentVersion = 3;
+	};
+
+	static const char* checkpointMagic()
+	{
+		return "BMACKPT";
 	}
 
-	double getCurrentProcessTime() const
+	bool writeCheckpoint() const
 	{
-		FILETIME cpuTime;
-		FILETIME sysTime;
-		FILETIME createTime;
-		FILETIME exitTime;
-		GetProcessTimes(GetCurrentProcess(), &createTime, &exitTime, &sysTime, &cpuTime);
-		ULARGE_INTEGER cpuTimeInt;
-		cpuTimeInt.LowPart = cpuTime.dwLowDateTime;
-		cpuTimeInt.HighPart = cpuTime.dwHighDateTime;
-		uint64_t nanoS = cpuTimeInt.QuadPart * 100;
-		return nanoS / 1000.0f / 1000.0f / 1000.0f;
+		CheckpointHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.m_magic, checkpointMagic(), sizeof(header.m_magic));
+		header.m_version = CheckpointHeader::CurrentVersion;
+		header.m_keyboardSize = static_cast<uint32_t>(KeyboardSize);
+		header.m_costSize = static_cast<uint32_t>(sizeof(FloatingPoint));
+		header.m_randomGeneratorSize = static_cast<uint32_t>(sizeof(RandomGenerator));
+		header.m_numWorkers = static_cast<uint32_t>(m_workers.size());
+		header.m_populationSize = m_population.size();
+		header.m_numElites = m_elites.size();
+		header.m_evaluationsUsed = m_budget.evaluationsUsed();
+		header.m_wallTime = m_budget.wallTimeElapsed();
+		header.m_cpuTime = m_budget.cpuTimeElapsed();
+		header.m_timeOfBest = m_timeOfBest;
+		header.m_numWithoutImprovement = m_numWithoutImprovement;
+		header.m_numMutations = m_numMutations;
+		return detail::writeFileAtomically(m_checkpointFile, [&](FILE* file)
+		{
+			bool ok = detail::writeValue(file, header) &&
+				detail::writeValue(file, m_randomGenerator) &&
+				detail::writeValue(file, std::get<0>(m_bestSolution)) &&
+				detail::writeValue(file, std::get<1>(m_bestSolution)) &&
+				detail::writeValue(file, m_prevBest) &&
+				detail::writeValues(file, m_population.data(), m_population.size()) &&
+				detail::writeValues(file, m_populationSolutions.data(), m_populationSolutions.size()) &&
+				detail::writeValues(file, m_elites.data(), m_elites.size());
+			for (auto&& worker : m_workers)
+			{
+				ok = ok && detail::writeValue(file, worker.m_randomGenerator);
+			}
+			return ok;
+		});
+	}
+
+	// Returns false when there's no checkpoint to continue from
+	bool readCheckpoint()
+	{
+		std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(m_checkpointFile.c_str(), "rb"), fclose);
+		if (!file)
+		{
+			return false;
+		}
+		CheckpointHeader header;
+		if (!detail::readValue(file.get(), header) ||
+			memcmp(header.m_magic, checkpointMagic(), sizeof(header.m_magic)) != 0 ||
+			header.m_version != CheckpointHeader::CurrentVersion ||
+			header.m_keyboardSize != KeyboardSize ||
+			header.m_costSize != sizeof(FloatingPoint) ||
+			header.m_randomGeneratorSize != sizeof(RandomGenerator) ||
+			header.m_numWorkers != m_workers.size() ||
+			header.m_populationSize != m_populationSize)
+		{
+			throw std::runtime_error("The checkpoint " + m_checkpointFile + " was written by a different build or with different settings");
+		}
+		m_population.resize(header.m_populationSize);
+		m_populationSolutions.resize(header.m_populationSize);
+		m_elites.resize(header.m_numElites);
+		FloatingPoint bestSolution;
+		bool ok = detail::readValue(file.get(), m_randomGenerator) &&
+			detail::readValue(file.get(), bestSolution) &&
+			detail::readValue(file.get(), std::get<1>(m_bestSolution)) &&
+			detail::readValue(file.get(), m_prevBest) &&
+			detail::readValues(file.get(), m_population.data(), m_population.size()) &&
+			detail::readValues(file.get(), m_populationSolutions.data(), m_populationSolutions.size()) &&
+			detail::readValues(file.get(), m_elites.data(), m_elites.size());
+		std::get<0>(m_bestSolution) = bestSolution;
+		for (auto&& worker : m_workers)
+		{
+			ok = ok && detail::readValue(file.get(), worker.m_randomGenerator);
+		}
+		if (!ok)
+		{
+			throw std::runtime_error("The checkpoint " + m_checkpointFile + " is truncated");
+		}
+		rebuildPopulationIndex();
+		m_eliteIndex.clear();
+		for (size_t i = 0; i < m_elites.size(); i++)
+		{
+			m_eliteIndex.insert(m_elites[i].m_hash, i);
+		}
+		m_timeOfBest = header.m_timeOfBest;
+		m_numWithoutImprovement = static_cast<size_t>(header.m_numWithoutImprovement);
+		m_numMutations = static_cast<size_t>(header.m_numMutations);
+		m_budget.resume(static_cast<size_t>(header.m_evaluationsUsed), header.m_wallTime, header.m_cpuTime);
+		return true;
 	}
 
 	void updateTimeOfBest()
 	{
 		if (std::get<0>(m_bestSolution) != m_prevBest)
 		{
-			m_timeOfBest = getCurrentProcessTime() - m_startTime;
+			m_timeOfBest = m_budget.timeElapsed();
 			m_prevBest = std::get<0>(m_bestSolution);
+			if (m_snapshotSink)
+			{
+				m_snapshotSink({ std::get<0>(m_bestSolution), std::get<1>(m_bestSolution), m_budget.evaluationsUsed(), m_timeOfBest });
+			}
 		}
 	}
 
 	std::vector<Keyboard<KeyboardSize>> m_population;
 	std::vector<FloatingPoint> m_populationSolutions;
+	std::vector<uint64_t> m_populationHashes;
+	detail::HashIndex m_populationIndex;
+	// Row major, only kept for the quality and distance replacement
+	std::vector<uint32_t> m_populationDistances;
 	size_t m_populationSize = 0;
 	float m_jumpMagnitude = 0.15f;
 	size_t m_stagnationAfter = 250;
@@ -842,35 +1763,58 @@ protected:
 	size_t m_mutationFrequency = 5;
 	float m_mutationStrenghtMin = 0.5f;
 	size_t m_mutationStrenghtGrowth = 5;
-	size_t m_snapshotEvery = 0;
 	float m_minT = 0.1f;
-	FloatingPoint m_target = std::numeric_limits<FloatingPoint>::max();
 	bool m_primarilyEvolution = false;
 	CrossoverType m_crossoverType = CrossoverType::PartiallyMatched;
 	PerturbType m_perturbType = PerturbType::Normal;
-	std::mt19937 m_randomGenerator;
+	ReplacementType m_replacementType = ReplacementType::Worst;
+	DescentType m_descentType = DescentType::Steepest;
+	size_t m_firstImprovementPasses = 1;
+	float m_qualityWeight = 0.6f;
+	float m_secondWorstProbability = 0.3f;
+	RandomGenerator m_randomGenerator;
 	std::tuple<FloatingPoint, Keyboard<KeyboardSize>> m_bestSolution = std::make_tuple(std::numeric_limits<FloatingPoint>::lowest(), Keyboard<KeyboardSize>());
 	FloatingPoint m_prevBest = std::numeric_limits<FloatingPoint>::lowest();
-	SnapshotArray m_snapshots;
-	int m_numEvaluationsLeft;
-	size_t m_totalEvaluations;
-	double m_startTime;
-	double m_maxTime = std::numeric_limits<double>::max();
+	SnapshotSink m_snapshotSink;
+	Instrumentation<EnableInstrumentation> m_instrumentation;
+	ScratchSpace<Workspace> m_workspace;
+	DeltaCache m_deltaCache;
+	Budget<FloatingPoint> m_budget;
 	double m_finalTime = std::numeric_limits<double>::max();
 	double m_timeOfBest = std::numeric_limits<double>::max();
+	std::function<void()> m_generationCallback;
+	size_t m_numThreads = 1;
+	// The threads of the workers, one per worker with the calling thread as the first
+	std::shared_ptr<detail::ThreadPool> m_threadPool;
+	// The locations of the objective of the run, the keys after them are the padding of a smaller instance
+	size_t m_numLocations = KeyboardSize;
+	std::vector<BMAOptimizer> m_workers;
+	const std::atomic<bool>* m_stop = nullptr;
+	std::string m_checkpointFile;
+	double m_checkpointInterval = 60.0;
+	size_t m_numCheckpointFailures = 0;
+	// The mutation schedule of the main loop, which is a part of the checkpoints
+	size_t m_numWithoutImprovement = 0;
+	size_t m_numMutations = 0;
 
-	static const FloatingPoint tolerance;
-	
 	struct Elite
 	{
-		Elite(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution) :
+		Elite() :
+			m_solution(),
+			m_hash(0),
+			m_improvedTimes(0)
+		{
+		}
+		Elite(const Keyboard<KeyboardSize>& keyboard, FloatingPoint solution, uint64_t hash) :
 			m_keyboard(keyboard),
 			m_solution(solution),
+			m_hash(hash),
 			m_improvedTimes(0)
 		{
 		}
 		Keyboard<KeyboardSize> m_keyboard;
 		FloatingPoint m_solution;
+		uint64_t m_hash;
 		mutable size_t m_improvedTimes;
 	};
 
@@ -889,11 +1833,12 @@ protected:
 		}
 	};
 
-	std::set<Elite, CompareElite> m_eliteSoFar;
+	// The distinct solutions of the elite archive, indexed by their hashes
+	std::vector<Elite> m_elites;
+	detail::HashIndex m_eliteIndex;
+	size_t m_eliteCapacity = 1000;
+	float m_eliteMinDistance = 0.1f;
 };
 
-template<size_t KeyboardSize, typename FloatingPoint>
-std::random_device BMAOptimizer<KeyboardSize, FloatingPoint>::rd;
-
-template<size_t KeyboardSize, typename FloatingPoint>
-const FloatingPoint BMAOptimizer<KeyboardSize, FloatingPoint>::tolerance = 0.0000001f;
\ No newline at end of file
+template<size_t KeyboardSize, typename FloatingPoint, typename RandomGenerator>
+std::random_device BMAOptimizer<KeyboardSize, FloatingPoint, RandomGenerator>::rd;
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Helpers for the binary files written by the library, the QAP instance cache and the optimizer checkpoints
+namespace detail
+{
+	// Calls write(file) on a temporary file, which is then renamed over filename, so that readers never see a partial file.
+	// Returns false and removes the temporary file if write returns false or anything fails
+	template<typename Write>
+	bool writeFileAtomically(const std::string& filename, Write&& write)
+	{
+#ifdef _WIN32
+		const std::string temporary = filename + ".tmp" + std::to_string(GetCurrentProcessId());
+#else
+		const std::string temporary = filename + ".tmp" + std::to_string(getpid());
+#endif
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+		bool ok = write(file);
+		ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+		ok = ok && MoveFileExA(temporary.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		ok = ok && rename(temporary.c_str(), filename.c_str()) == 0;
+#endif
+		if (!ok)
+		{
+			remove(temporary.c_str());
+		}
+		return ok;
+	}
+
+	// The values are written as they are in memory, so the files can only be read by the same build
+	template<typename T>
+	bool writeValues(FILE* file, const T* values, size_t count)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written as they are");
+		return count == 0 || fwrite(values, sizeof(T), count, file) == count;
+	}
+
+	template<typename T>
+	bool writeValue(FILE* file, const T& value)
+	{
+		return writeValues(file, &value, 1);
+	}
+
+	template<typename T>
+	bool readValues(FILE* file, T* values, size_t count)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read as they are");
+		return count == 0 || fread(values, sizeof(T), count, file) == count;
+	}
+
+	template<typename T>
+	bool readValue(FILE* file, T& value)
+	{
+		return readValues(file, &value, 1);
+	}
+}
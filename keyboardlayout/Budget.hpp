@@ -0,0 +1,187 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "Objective.hpp"
+
+namespace detail
+{
+	// The CPU time of the whole process in seconds, all threads included
+	inline double processCpuTime()
+	{
+#ifdef _WIN32
+		FILETIME createTime;
+		FILETIME exitTime;
+		FILETIME sysTime;
+		FILETIME cpuTime;
+		GetProcessTimes(GetCurrentProcess(), &createTime, &exitTime, &sysTime, &cpuTime);
+		ULARGE_INTEGER cpuTimeInt;
+		cpuTimeInt.LowPart = cpuTime.dwLowDateTime;
+		cpuTimeInt.HighPart = cpuTime.dwHighDateTime;
+		return static_cast<double>(cpuTimeInt.QuadPart) * 100.0 / 1000000000.0;
+#else
+		timespec t;
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+		return static_cast<double>(t.tv_sec) + static_cast<double>(t.tv_nsec) / 1000000000.0;
+#endif
+	}
+}
+
+// The stopping criteria of an optimization run: an evaluation budget, wall clock and CPU time limits, a target cost
+// and an external stop flag. The evaluations, the target and the flag are checked on every call to exhausted, but the
+// clocks are only read on every checkInterval:th call, since reading the CPU time is a system call.
+template<typename Cost = float>
+class Budget
+{
+	typedef detail::CostTraits<Cost> Traits;
+	typedef std::chrono::steady_clock Clock;
+public:
+	void evaluations(size_t numEvaluations)
+	{
+		m_totalEvaluations = static_cast<int64_t>(numEvaluations);
+		m_evaluationsLeft = m_totalEvaluations;
+	}
+
+	// In seconds
+	void wallTime(double t)
+	{
+		m_maxWallTime = t;
+	}
+
+	// In seconds of process CPU time, which grows with the number of threads
+	void cpuTime(double t)
+	{
+		m_maxCpuTime = t;
+	}
+
+	void target(Cost target)
+	{
+		m_target = target;
+	}
+
+	// The run stops as soon as the flag is set
+	void stopFlag(const std::atomic<bool>* stop)
+	{
+		m_stop = stop;
+	}
+
+	void checkInterval(uint32_t interval)
+	{
+		m_checkInterval = interval > 0 ? interval : 1;
+	}
+
+	// Starts the clocks and restores the evaluation budget
+	void start()
+	{
+		m_startWallTime = Clock::now();
+		m_startCpuTime = detail::processCpuTime();
+		m_evaluationsLeft = m_totalEvaluations;
+		m_outOfTime = false;
+		m_checkCountdown = 0;
+	}
+
+	// Starts the clocks like start, but continues a run that had already used the given evaluations and time
+	void resume(size_t numEvaluationsUsed, double wallTimeUsed, double cpuTimeUsed)
+	{
+		start();
+		m_evaluationsLeft -= static_cast<int64_t>(numEvaluationsUsed);
+		m_startWallTime -= std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wallTimeUsed));
+		m_startCpuTime -= cpuTimeUsed;
+	}
+
+	void consume(size_t numEvaluations)
+	{
+		m_evaluationsLeft -= static_cast<int64_t>(numEvaluations);
+	}
+
+	bool exhausted(Cost best = std::numeric_limits<Cost>::lowest())
+	{
+		return m_evaluationsLeft <= 0 || targetReached(best) || stopRequested() || outOfTime();
+	}
+
+	// Like exhausted, but always reads the clocks. For the checks that are too infrequent to be amortized
+	bool exhaustedNow(Cost best = std::numeric_limits<Cost>::lowest())
+	{
+		m_checkCountdown = 0;
+		return exhausted(best);
+	}
+
+	bool targetReached(Cost best) const
+	{
+		return !Traits::isBelowTarget(best, m_target);
+	}
+
+	bool stopRequested() const
+	{
+		return m_stop && m_stop->load(std::memory_order_relaxed);
+	}
+
+	int64_t evaluationsLeft() const
+	{
+		return m_evaluationsLeft;
+	}
+
+	size_t evaluationsUsed() const
+	{
+		return static_cast<size_t>(m_totalEvaluations - m_evaluationsLeft);
+	}
+
+	double wallTimeElapsed() const
+	{
+		return std::chrono::duration<double>(Clock::now() - m_startWallTime).count();
+	}
+
+	double cpuTimeElapsed() const
+	{
+		return detail::processCpuTime() - m_startCpuTime;
+	}
+
+	// The elapsed time on the clock the budget is limited by, wall clock time when there's a wall clock limit
+	double timeElapsed() const
+	{
+		return m_maxWallTime < std::numeric_limits<double>::max() ? wallTimeElapsed() : cpuTimeElapsed();
+	}
+
+private:
+	bool outOfTime()
+	{
+		if (m_outOfTime || m_checkCountdown-- > 0)
+		{
+			return m_outOfTime;
+		}
+		m_checkCountdown = m_checkInterval - 1;
+		if (m_maxWallTime < std::numeric_limits<double>::max() && wallTimeElapsed() >= m_maxWallTime)
+		{
+			m_outOfTime = true;
+		}
+		else if (m_maxCpuTime < std::numeric_limits<double>::max() && cpuTimeElapsed() >= m_maxCpuTime)
+		{
+			m_outOfTime = true;
+		}
+		return m_outOfTime;
+	}
+
+	int64_t m_totalEvaluations = std::numeric_limits<int64_t>::max();
+	int64_t m_evaluationsLeft = std::numeric_limits<int64_t>::max();
+	double m_maxWallTime = std::numeric_limits<double>::max();
+	double m_maxCpuTime = std::numeric_limits<double>::max();
+	Cost m_target = std::numeric_limits<Cost>::max();
+	const std::atomic<bool>* m_stop = nullptr;
+	uint32_t m_checkInterval = 64;
+	uint32_t m_checkCountdown = 0;
+	bool m_outOfTime = false;
+	Clock::time_point m_startWallTime = Clock::now();
+	double m_startCpuTime = 0.0;
+};
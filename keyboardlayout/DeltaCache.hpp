@@ -0,0 +1,167 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "Keyboard.hpp"
+#include "HashIndex.hpp"
+
+namespace detail
+{
+	// The fewest swaps of two positions that turn the keyboard from into the keyboard to, with the first position of
+	// every swap before the second. Returns false when more than maxSwaps are needed
+	template<size_t KeyboardSize>
+	bool swapSequence(const Keyboard<KeyboardSize>& from, const Keyboard<KeyboardSize>& to, size_t maxSwaps, std::vector<std::pair<uint16_t, uint16_t>>& swaps)
+	{
+		swaps.clear();
+		Keyboard<KeyboardSize> current = from;
+		std::array<size_t, KeyboardSize> positions;
+		for (size_t i = 0; i < KeyboardSize; i++)
+		{
+			positions[current.m_keys[i]] = i;
+		}
+		// The positions before i already match, so the key that belongs to i is always found after it
+		for (size_t i = 0; i < KeyboardSize; i++)
+		{
+			if (current.m_keys[i] != to.m_keys[i])
+			{
+				if (swaps.size() == maxSwaps)
+				{
+					return false;
+				}
+				const size_t j = positions[to.m_keys[i]];
+				positions[current.m_keys[i]] = j;
+				std::swap(current.m_keys[i], current.m_keys[j]);
+				swaps.emplace_back(static_cast<uint16_t>(i), static_cast<uint16_t>(j));
+			}
+		}
+		return true;
+	}
+
+	// The delta matrices of the keyboards that local searches have ended at, so that the searches that start from them
+	// don't need to rebuild the matrices. An entry stores the matrix of a base keyboard, and the swaps that turn the base
+	// into the keyboard of the entry, which are replayed with partial updates. The replayed matrix is only identical to a
+	// rebuilt one for exact costs, such as integers. The oldest entry is evicted when the cache is full. Copies of a cache
+	// start empty, so every worker and island has a cache of its own.
+	template<size_t KeyboardSize, typename FloatingPoint>
+	class DeltaCache
+	{
+	public:
+		typedef std::array<std::array<FloatingPoint, KeyboardSize>, KeyboardSize> DeltaArray;
+		typedef std::tuple<size_t, size_t, FloatingPoint> Move;
+		// From < to
+		typedef std::pair<uint16_t, uint16_t> Swap;
+		// A partial update costs about as much as a full rebuild of n / 16 to n / 32 rows, so only a few are replayed
+		static constexpr size_t MaxSwaps = KeyboardSize / 32 + 1;
+
+		struct Entry
+		{
+			Keyboard<KeyboardSize> m_keyboard;
+			uint64_t m_hash;
+			Keyboard<KeyboardSize> m_base;
+			FloatingPoint m_baseCost;
+			DeltaArray m_delta;
+			Move m_bestMove;
+			std::vector<Swap> m_swaps;
+		};
+
+		DeltaCache() = default;
+
+		DeltaCache(const DeltaCache& other) :
+			m_maxEntries(other.m_maxEntries)
+		{
+		}
+
+		DeltaCache& operator=(const DeltaCache& other)
+		{
+			if (this != &other)
+			{
+				m_maxEntries = other.m_maxEntries;
+				clear();
+			}
+			return *this;
+		}
+
+		// The entries are allocated as they are needed, up to maxBytes. Zero disables the cache
+		void capacity(size_t maxBytes)
+		{
+			m_maxEntries = maxBytes / sizeof(Entry);
+			clear();
+		}
+
+		bool enabled() const
+		{
+			return m_maxEntries > 0;
+		}
+
+		size_t size() const
+		{
+			return m_entries.size();
+		}
+
+		void clear()
+		{
+			m_entries.clear();
+			m_index.clear();
+			m_next = 0;
+		}
+
+		Entry* find(const Keyboard<KeyboardSize>& keyboard, uint64_t hash)
+		{
+			const size_t i = m_index.find(hash, [this, &keyboard](size_t i) { return m_entries[i]->m_keyboard == keyboard; });
+			return i != HashIndex::NotFound ? m_entries[i].get() : nullptr;
+		}
+
+		// Returns the entry of the keyboard, evicting the oldest entry if needed. The caller fills in the rest of the entry
+		Entry& insert(const Keyboard<KeyboardSize>& keyboard, uint64_t hash)
+		{
+			Entry* entry = find(keyboard, hash);
+			if (entry)
+			{
+				return *entry;
+			}
+			size_t i = m_entries.size();
+			if (i < m_maxEntries)
+			{
+				m_entries.emplace_back(new Entry());
+			}
+			else
+			{
+				i = m_next;
+				m_next = (m_next + 1) % m_maxEntries;
+				m_index.erase(m_entries[i]->m_hash, i);
+			}
+			m_entries[i]->m_keyboard = keyboard;
+			m_entries[i]->m_hash = hash;
+			m_index.insert(hash, i);
+			return *m_entries[i];
+		}
+
+		// Moves the entry of a keyboard to the keyboard that the swaps turn it into. The entry is left as it is when the
+		// swaps make the replay too long, or when the new keyboard already has an entry
+		bool extend(const Keyboard<KeyboardSize>& keyboard, uint64_t hash, const Keyboard<KeyboardSize>& newKeyboard, uint64_t newHash, const std::vector<Swap>& swaps)
+		{
+			const size_t i = m_index.find(hash, [this, &keyboard](size_t i) { return m_entries[i]->m_keyboard == keyboard; });
+			if (i == HashIndex::NotFound || m_entries[i]->m_swaps.size() + swaps.size() > MaxSwaps || find(newKeyboard, newHash))
+			{
+				return false;
+			}
+			Entry* entry = m_entries[i].get();
+			m_index.erase(hash, i);
+			entry->m_keyboard = newKeyboard;
+			entry->m_hash = newHash;
+			entry->m_swaps.insert(entry->m_swaps.end(), swaps.begin(), swaps.end());
+			m_index.insert(newHash, i);
+			return true;
+		}
+
+	private:
+		size_t m_maxEntries = 0;
+		size_t m_next = 0;
+		// Allocated one by one, since an entry holds a whole delta matrix
+		std::vector<std::unique_ptr<Entry>> m_entries;
+		HashIndex m_index;
+	};
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace detail
+{
+	// Open addressing hash index from the hashes of items to their positions in an array that is stored elsewhere.
+	// The same hash can be inserted for several positions, so the items don't need to be unique.
+	// Uses linear probing, and deletion shifts the following slots back so that no tombstones are needed.
+	class HashIndex
+	{
+	public:
+		static constexpr size_t NotFound = std::numeric_limits<size_t>::max();
+
+		HashIndex()
+		{
+			m_slots.resize(MinCapacity);
+		}
+
+		void clear()
+		{
+			m_slots.assign(m_slots.size(), Slot());
+			m_size = 0;
+		}
+
+		size_t size() const
+		{
+			return m_size;
+		}
+
+		// Returns the first position with the hash for which equal(position) holds, or NotFound
+		template<typename Equal>
+		size_t find(uint64_t hash, Equal&& equal) const
+		{
+			const size_t mask = m_slots.size() - 1;
+			for (size_t i = static_cast<size_t>(hash) & mask; m_slots[i].m_position != Empty; i = (i + 1) & mask)
+			{
+				if (m_slots[i].m_hash == hash && equal(static_cast<size_t>(m_slots[i].m_position)))
+				{
+					return m_slots[i].m_position;
+				}
+			}
+			return NotFound;
+		}
+
+		void insert(uint64_t hash, size_t position)
+		{
+			if ((m_size + 1) * 2 > m_slots.size())
+			{
+				grow();
+			}
+			place(hash, static_cast<uint32_t>(position));
+			m_size++;
+		}
+
+		void erase(uint64_t hash, size_t position)
+		{
+			const size_t mask = m_slots.size() - 1;
+			size_t i = static_cast<size_t>(hash) & mask;
+			for (; m_slots[i].m_position != Empty; i = (i + 1) & mask)
+			{
+				if (m_slots[i].m_hash == hash && m_slots[i].m_position == position)
+				{
+					break;
+				}
+			}
+			if (m_slots[i].m_position == Empty)
+			{
+				return;
+			}
+			m_size--;
+			// Move back the following slots of the cluster that can't be found anymore once the slot is empty
+			for (size_t j = (i + 1) & mask; m_slots[j].m_position != Empty; j = (j + 1) & mask)
+			{
+				size_t home = static_cast<size_t>(m_slots[j].m_hash) & mask;
+				if (((j - home) & mask) >= ((j - i) & mask))
+				{
+					m_slots[i] = m_slots[j];
+					i = j;
+				}
+			}
+			m_slots[i] = Slot();
+		}
+
+	private:
+		static constexpr uint32_t Empty = std::numeric_limits<uint32_t>::max();
+		static constexpr size_t MinCapacity = 16;
+
+		struct Slot
+		{
+			uint64_t m_hash = 0;
+			uint32_t m_position = Empty;
+		};
+
+		void place(uint64_t hash, uint32_t position)
+		{
+			const size_t mask = m_slots.size() - 1;
+			size_t i = static_cast<size_t>(hash) & mask;
+			while (m_slots[i].m_position != Empty)
+			{
+				i = (i + 1) & mask;
+			}
+			m_slots[i].m_hash = hash;
+			m_slots[i].m_position = position;
+		}
+
+		void grow()
+		{
+			std::vector<Slot> slots(m_slots.size() * 2);
+			std::swap(slots, m_slots);
+			for (auto&& slot : slots)
+			{
+				if (slot.m_position != Empty)
+				{
+					place(slot.m_hash, slot.m_position);
+				}
+			}
+		}
+
+		std::vector<Slot> m_slots;
+		size_t m_size = 0;
+	};
+}
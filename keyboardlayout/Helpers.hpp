@@ -1,5 +1,9 @@
 #pragma once
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
 
 template<typename First, typename Second>
 bool isDominated(const First& first, const Second& second)
@@ -25,13 +29,13 @@ struct InOut : public std::reference_wrapper<T>
 {
 public:
 	explicit InOut(T& v)
-		: reference_wrapper<T>(v)
+		: std::reference_wrapper<T>(v)
 	{
 	}
 
 	InOut(const InOut&) = delete;
 	InOut(InOut&& rhs)
-		: reference_wrapper(rhs.get())
+		: std::reference_wrapper<T>(rhs.get())
 	{
 	}
 
@@ -40,7 +44,7 @@ public:
 
 	InOut& operator=(const T& v)
 	{
-		get() = v;
+		this->get() = v;
 		return *this;
 	}
 };
@@ -56,3 +60,55 @@ InOut<T> inOut(InOut<T>& i)
 {
 	return inOut(i.get());
 }
+
+// A heap allocated T for scratch data, allocated on the first use. Copying the owner doesn't copy or share the
+// contents, so every copy, such as the worker of a thread, gets a scratch space of its own
+template<typename T>
+class ScratchSpace
+{
+public:
+	ScratchSpace() = default;
+
+	ScratchSpace(const ScratchSpace&)
+	{
+	}
+
+	ScratchSpace& operator=(const ScratchSpace&)
+	{
+		return *this;
+	}
+
+	T& get()
+	{
+		if (!m_value)
+		{
+			m_value.reset(new T);
+		}
+		return *m_value;
+	}
+
+private:
+	std::unique_ptr<T> m_value;
+};
+
+template<size_t... Sizes>
+struct SizeList
+{
+};
+
+template<typename Fn, typename Fallback>
+auto dispatchSize(SizeList<>, size_t size, Fn&& fn, Fallback&& fallback) -> decltype(fallback())
+{
+	return fallback();
+}
+
+// Calls fn with a std::integral_constant of the smallest size in the ascending list that can hold size, or fallback if none can
+template<typename Fn, typename Fallback, size_t Size, size_t... Rest>
+auto dispatchSize(SizeList<Size, Rest...>, size_t size, Fn&& fn, Fallback&& fallback) -> decltype(fallback())
+{
+	if (size <= Size)
+	{
+		return fn(std::integral_constant<size_t, Size>());
+	}
+	return dispatchSize(SizeList<Rest...>(), size, std::forward<Fn>(fn), std::forward<Fallback>(fallback));
+}
@@ -0,0 +1,495 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <regex>
+#include <stdexcept>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "QAPKernels.hpp"
+#include "BinaryFile.hpp"
+
+// Loading of the QAPLIB and mQAP instance files. The text is memory mapped and parsed in place, and QAP instances can
+// additionally be stored in a binary cache file, which is mapped read only so that concurrent runs share the same pages.
+namespace detail
+{
+	// Read only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::string& filename)
+		{
+#ifdef _WIN32
+			m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (m_file == INVALID_HANDLE_VALUE)
+			{
+				return;
+			}
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(m_file, &size))
+			{
+				return;
+			}
+			m_size = static_cast<size_t>(size.QuadPart);
+			m_open = true;
+			if (m_size == 0)
+			{
+				return;
+			}
+			m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (m_mapping)
+			{
+				m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+			}
+#else
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				return;
+			}
+			struct stat info;
+			if (fstat(fd, &info) == 0)
+			{
+				m_size = static_cast<size_t>(info.st_size);
+				m_open = true;
+				if (m_size != 0)
+				{
+					void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+					if (data != MAP_FAILED)
+					{
+						m_data = static_cast<const char*>(data);
+					}
+				}
+			}
+			close(fd);
+#endif
+			if (m_size != 0 && !m_data)
+			{
+				m_open = false;
+			}
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		~MappedFile()
+		{
+#ifdef _WIN32
+			if (m_data)
+			{
+				UnmapViewOfFile(m_data);
+			}
+			if (m_mapping)
+			{
+				CloseHandle(m_mapping);
+			}
+			if (m_file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(m_file);
+			}
+#else
+			if (m_data)
+			{
+				munmap(const_cast<char*>(m_data), m_size);
+			}
+#endif
+		}
+
+		bool isOpen() const
+		{
+			return m_open;
+		}
+
+		const char* data() const
+		{
+			return m_data;
+		}
+
+		size_t size() const
+		{
+			return m_size;
+		}
+
+	private:
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+		bool m_open = false;
+#ifdef _WIN32
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = nullptr;
+#endif
+	};
+
+	// Sequential parser of the whitespace separated integers of an instance file
+	class IntegerParser
+	{
+	public:
+		IntegerParser(const char* begin, const char* end)
+			: m_current(begin)
+			, m_end(end)
+		{
+		}
+
+		// Returns false when there are no more integers
+		bool next(int64_t& value)
+		{
+			while (m_current != m_end && !isDigit(*m_current) && !(*m_current == '-' && m_current + 1 != m_end && isDigit(m_current[1])))
+			{
+				m_current++;
+			}
+			if (m_current == m_end)
+			{
+				return false;
+			}
+			bool negative = *m_current == '-';
+			if (negative)
+			{
+				m_current++;
+			}
+			uint64_t v = 0;
+			while (m_current != m_end && isDigit(*m_current))
+			{
+				v = v * 10 + static_cast<uint64_t>(*m_current - '0');
+				m_current++;
+			}
+			value = negative ? -static_cast<int64_t>(v) : static_cast<int64_t>(v);
+			return true;
+		}
+
+		int64_t expect()
+		{
+			int64_t value;
+			if (!next(value))
+			{
+				throw std::runtime_error("Unexpected end of the instance file");
+			}
+			return value;
+		}
+
+	private:
+		static bool isDigit(char c)
+		{
+			return c >= '0' && c <= '9';
+		}
+
+		const char* m_current;
+		const char* m_end;
+	};
+
+	inline size_t qapValueSize(QAPValueType type)
+	{
+		switch (type)
+		{
+		case QAPValueType::Int8:
+			return sizeof(int8_t);
+		case QAPValueType::Int16:
+			return sizeof(int16_t);
+		case QAPValueType::Int32:
+			return sizeof(int32_t);
+		default:
+			return sizeof(int64_t);
+		}
+	}
+
+	// The storage of a square matrix including the padding of the vectorized kernels, rounded up so that the next matrix stays aligned
+	inline size_t qapMatrixBytes(size_t numLocations, QAPValueType type)
+	{
+		const size_t bytes = numLocations * numLocations * qapValueSize(type) + QAPMatrixPadding;
+		return (bytes + sizeof(int64_t) - 1) / sizeof(int64_t) * sizeof(int64_t);
+	}
+
+	inline int64_t qapLoadValue(const uint8_t* data, QAPValueType type, size_t index)
+	{
+		switch (type)
+		{
+		case QAPValueType::Int8:
+			return reinterpret_cast<const int8_t*>(data)[index];
+		case QAPValueType::Int16:
+			return reinterpret_cast<const int16_t*>(data)[index];
+		case QAPValueType::Int32:
+			return reinterpret_cast<const int32_t*>(data)[index];
+		default:
+			return reinterpret_cast<const int64_t*>(data)[index];
+		}
+	}
+
+	inline void qapStoreValue(uint8_t* data, QAPValueType type, size_t index, int64_t value)
+	{
+		switch (type)
+		{
+		case QAPValueType::Int8:
+			reinterpret_cast<int8_t*>(data)[index] = static_cast<int8_t>(value);
+			break;
+		case QAPValueType::Int16:
+			reinterpret_cast<int16_t*>(data)[index] = static_cast<int16_t>(value);
+			break;
+		case QAPValueType::Int32:
+			reinterpret_cast<int32_t*>(data)[index] = static_cast<int32_t>(value);
+			break;
+		default:
+			reinterpret_cast<int64_t*>(data)[index] = value;
+			break;
+		}
+	}
+
+	// The two matrices of a QAPLIB instance, stored row major with a row stride of numLocations in the narrowest type that fits.
+	// The storage is either owned or a mapped cache file, m_storage keeps it alive.
+	struct QAPInstance
+	{
+		int64_t distance(size_t i, size_t j) const
+		{
+			return qapLoadValue(m_distances, m_valueType, i * m_numLocations + j);
+		}
+
+		int64_t flow(size_t i, size_t j) const
+		{
+			return qapLoadValue(m_flow, m_valueType, i * m_numLocations + j);
+		}
+
+		size_t m_numLocations = 0;
+		QAPValueType m_valueType = QAPValueType::Int64;
+		const uint8_t* m_distances = nullptr;
+		const uint8_t* m_flow = nullptr;
+		std::shared_ptr<const void> m_storage;
+	};
+
+	// Allocates zeroed storage for both matrices of an instance
+	inline uint8_t* allocateQAPInstance(QAPInstance& instance, size_t numLocations, QAPValueType type)
+	{
+		const size_t matrixBytes = qapMatrixBytes(numLocations, type);
+		auto storage = std::make_shared<std::vector<uint64_t>>(2 * matrixBytes / sizeof(uint64_t), 0);
+		uint8_t* data = reinterpret_cast<uint8_t*>(storage->data());
+		instance.m_numLocations = numLocations;
+		instance.m_valueType = type;
+		instance.m_distances = data;
+		instance.m_flow = data + matrixBytes;
+		instance.m_storage = storage;
+		return data;
+	}
+
+	inline QAPInstance parseQAPInstance(const char* begin, const char* end)
+	{
+		IntegerParser parser(begin, end);
+		const size_t numLocations = static_cast<size_t>(parser.expect());
+		std::vector<int64_t> values(2 * numLocations * numLocations);
+		for (auto&& v : values)
+		{
+			v = parser.expect();
+		}
+		int64_t minValue = 0;
+		int64_t maxValue = 0;
+		if (!values.empty())
+		{
+			auto range = std::minmax_element(values.begin(), values.end());
+			minValue = *range.first;
+			maxValue = *range.second;
+		}
+
+		QAPInstance instance;
+		const QAPValueType type = qapSelectValueType(minValue, maxValue);
+		uint8_t* distances = allocateQAPInstance(instance, numLocations, type);
+		uint8_t* flow = distances + qapMatrixBytes(numLocations, type);
+		const size_t size = numLocations * numLocations;
+		for (size_t i = 0; i < size; i++)
+		{
+			qapStoreValue(distances, type, i, values[i]);
+			qapStoreValue(flow, type, i, values[size + i]);
+		}
+		return instance;
+	}
+
+	// The binary cache starts with this header, followed by the two matrices at multiples of 8 bytes.
+	// The size and modification time of the text file are stored so that a stale cache is detected.
+	struct QAPCacheHeader
+	{
+		static const uint32_t CurrentVersion = 1;
+
+		char m_magic[8];
+		uint32_t m_version;
+		uint32_t m_valueType;
+		uint64_t m_numLocations;
+		uint64_t m_sourceSize;
+		int64_t m_sourceModified;
+		uint8_t m_reserved[24];
+	};
+	static_assert(sizeof(QAPCacheHeader) == 64, "The cache header should keep the matrices aligned");
+
+	inline const char* qapCacheMagic()
+	{
+		return "QAPCACHE";
+	}
+
+	inline bool qapSourceInfo(const std::string& filename, uint64_t& size, int64_t& modified)
+	{
+		struct stat info;
+		if (stat(filename.c_str(), &info) != 0)
+		{
+			return false;
+		}
+		size = static_cast<uint64_t>(info.st_size);
+		modified = static_cast<int64_t>(info.st_mtime);
+		return true;
+	}
+
+	// Uses the mapping of a cache file as the storage of the instance, returns false if the file isn't a valid cache
+	inline bool mapQAPCache(const std::shared_ptr<MappedFile>& file, QAPInstance& instance, const QAPCacheHeader** header)
+	{
+		if (!file->isOpen() || file->size() < sizeof(QAPCacheHeader))
+		{
+			return false;
+		}
+		QAPCacheHeader h;
+		memcpy(&h, file->data(), sizeof(h));
+		if (memcmp(h.m_magic, qapCacheMagic(), sizeof(h.m_magic)) != 0 || h.m_version != QAPCacheHeader::CurrentVersion ||
+			h.m_valueType > static_cast<uint32_t>(QAPValueType::Int64))
+		{
+			return false;
+		}
+		const QAPValueType type = static_cast<QAPValueType>(h.m_valueType);
+		const size_t numLocations = static_cast<size_t>(h.m_numLocations);
+		const size_t matrixBytes = qapMatrixBytes(numLocations, type);
+		if (file->size() != sizeof(QAPCacheHeader) + 2 * matrixBytes)
+		{
+			return false;
+		}
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(file->data()) + sizeof(QAPCacheHeader);
+		instance.m_numLocations = numLocations;
+		instance.m_valueType = type;
+		instance.m_distances = data;
+		instance.m_flow = data + matrixBytes;
+		instance.m_storage = file;
+		if (header)
+		{
+			*header = reinterpret_cast<const QAPCacheHeader*>(file->data());
+		}
+		return true;
+	}
+
+	// Writes the cache to a temporary file first and renames it, so that concurrent readers never see a partial file
+	inline bool writeQAPCache(const QAPInstance& instance, const std::string& filename, uint64_t sourceSize = 0, int64_t sourceModified = 0)
+	{
+		QAPCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.m_magic, qapCacheMagic(), sizeof(header.m_magic));
+		header.m_version = QAPCacheHeader::CurrentVersion;
+		header.m_valueType = static_cast<uint32_t>(instance.m_valueType);
+		header.m_numLocations = instance.m_numLocations;
+		header.m_sourceSize = sourceSize;
+		header.m_sourceModified = sourceModified;
+
+		const size_t matrixBytes = qapMatrixBytes(instance.m_numLocations, instance.m_valueType);
+		return writeFileAtomically(filename, [&](FILE* file)
+		{
+			return writeValue(file, header) &&
+				writeValues(file, instance.m_distances, matrixBytes) &&
+				writeValues(file, instance.m_flow, matrixBytes);
+		});
+	}
+
+	// Loads either a QAPLIB text file or a binary cache file
+	inline QAPInstance loadQAPInstance(const std::string& filename)
+	{
+		auto file = std::make_shared<MappedFile>(filename);
+		if (!file->isOpen())
+		{
+			throw std::invalid_argument("Can't open the QAP instance " + filename);
+		}
+		QAPInstance instance;
+		if (mapQAPCache(file, instance, nullptr))
+		{
+			return instance;
+		}
+		return parseQAPInstance(file->data(), file->data() + file->size());
+	}
+
+	// Loads the text file through the cache file, which is created or refreshed when it doesn't match the text file
+	inline QAPInstance loadQAPInstance(const std::string& filename, const std::string& cacheFilename)
+	{
+		uint64_t sourceSize = 0;
+		int64_t sourceModified = 0;
+		if (!qapSourceInfo(filename, sourceSize, sourceModified))
+		{
+			throw std::invalid_argument("Can't open the QAP instance " + filename);
+		}
+		QAPInstance instance;
+		const QAPCacheHeader* header = nullptr;
+		if (mapQAPCache(std::make_shared<MappedFile>(cacheFilename), instance, &header) &&
+			header->m_sourceSize == sourceSize && header->m_sourceModified == sourceModified)
+		{
+			return instance;
+		}
+		instance = loadQAPInstance(filename);
+		writeQAPCache(instance, cacheFilename, sourceSize, sourceModified);
+		return instance;
+	}
+
+	// All the matrices of a multi objective mQAP instance, the distance matrix followed by one flow matrix per objective
+	struct mQAPInstance
+	{
+		size_t m_numLocations = 0;
+		size_t m_numObjectives = 0;
+		std::vector<int> m_distances;
+		std::vector<std::vector<int>> m_flows;
+	};
+
+	inline mQAPInstance loadmQAPInstance(const std::string& filename)
+	{
+		MappedFile file(filename);
+		if (!file.isOpen())
+		{
+			throw std::invalid_argument("Can't open the mQAP instance " + filename);
+		}
+		const char* end = file.data() + file.size();
+		const char* headerEnd = std::find(file.data(), end, '\n');
+		const std::string header(file.data(), headerEnd);
+
+		// The header format varies between the files, for example "facilities: 10" and "facilities = 10"
+		mQAPInstance instance;
+		std::smatch match;
+		if (!std::regex_search(header, match, std::regex("facilities\\s*[:=]\\s*(\\d+)")))
+		{
+			throw std::runtime_error("The mQAP instance has no facilities in the header");
+		}
+		instance.m_numLocations = std::stoul(match.str(1));
+
+		// The distance matrix is followed by as many flow matrices as there are objectives
+		const size_t size = instance.m_numLocations * instance.m_numLocations;
+		IntegerParser parser(headerEnd, end);
+		instance.m_distances.resize(size);
+		for (auto&& v : instance.m_distances)
+		{
+			v = static_cast<int>(parser.expect());
+		}
+		int64_t value;
+		while (parser.next(value))
+		{
+			instance.m_flows.emplace_back(size);
+			auto& flow = instance.m_flows.back();
+			flow[0] = static_cast<int>(value);
+			for (size_t i = 1; i < size; i++)
+			{
+				flow[i] = static_cast<int>(parser.expect());
+			}
+		}
+		instance.m_numObjectives = instance.m_flows.size();
+		return instance;
+	}
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Instrumentation of the BMA, enabled by compiling with BMA_INSTRUMENTATION=1. When it's disabled the counters and
+// the timers are empty functions, so they cost nothing
+#ifndef BMA_INSTRUMENTATION
+#define BMA_INSTRUMENTATION 0
+#endif
+
+enum class InstrumentationCounter
+{
+	Iterations,
+	ImprovingMoves,
+	TabuPerturbations,
+	RandomPerturbations,
+	Mutations,
+	EliteRestarts,
+	DuplicateRejections,
+	FullDeltaBuilds,
+	PartialDeltaUpdates,
+	DeltaCacheHits,
+	MoveEvaluations,
+	Count,
+};
+
+enum class InstrumentationPhase
+{
+	Crossover,
+	InitialDeltas,
+	Descent,
+	Perturbation,
+	Mutation,
+	Count,
+	None = Count,
+};
+
+namespace detail
+{
+	inline const char* instrumentationName(InstrumentationCounter counter)
+	{
+		static const char* names[] = { "iterations", "improving_moves", "tabu_perturbations", "random_perturbations", "mutations",
+			"elite_restarts", "duplicate_rejections", "full_delta_builds", "partial_delta_updates", "delta_cache_hits", "move_evaluations" };
+		return names[static_cast<size_t>(counter)];
+	}
+
+	inline const char* instrumentationName(InstrumentationPhase phase)
+	{
+		static const char* names[] = { "crossover", "initial_deltas", "descent", "perturbation", "mutation" };
+		return names[static_cast<size_t>(phase)];
+	}
+}
+
+// The time of a phase excludes the phases nested inside it, so the times of the phases add up to the instrumented time.
+// With several threads the counts and the times are summed over the threads
+template<bool Enabled>
+class Instrumentation
+{
+	typedef std::chrono::steady_clock Clock;
+public:
+	// Measures the time from the construction to the destruction as the given phase
+	class ScopedPhase
+	{
+	public:
+		ScopedPhase(Instrumentation& instrumentation, InstrumentationPhase phase) :
+			m_instrumentation(instrumentation),
+			m_outer(instrumentation.m_current)
+		{
+			m_instrumentation.enter(phase);
+		}
+
+		~ScopedPhase()
+		{
+			m_instrumentation.enter(m_outer);
+		}
+
+		ScopedPhase(const ScopedPhase&) = delete;
+		ScopedPhase& operator=(const ScopedPhase&) = delete;
+	private:
+		Instrumentation& m_instrumentation;
+		InstrumentationPhase m_outer;
+	};
+
+	Instrumentation()
+	{
+		clear();
+	}
+
+	void count(InstrumentationCounter counter, uint64_t n = 1)
+	{
+		m_counters[static_cast<size_t>(counter)] += n;
+	}
+
+	uint64_t counter(InstrumentationCounter counter) const
+	{
+		return m_counters[static_cast<size_t>(counter)];
+	}
+
+	// In seconds
+	double time(InstrumentationPhase phase) const
+	{
+		return std::chrono::duration<double>(m_times[static_cast<size_t>(phase)]).count();
+	}
+
+	void merge(const Instrumentation& other)
+	{
+		for (size_t i = 0; i < m_counters.size(); i++)
+		{
+			m_counters[i] += other.m_counters[i];
+		}
+		for (size_t i = 0; i < m_times.size(); i++)
+		{
+			m_times[i] += other.m_times[i];
+		}
+	}
+
+	void clear()
+	{
+		m_counters.fill(0);
+		m_times.fill(Clock::duration::zero());
+		m_current = InstrumentationPhase::None;
+	}
+
+private:
+	void enter(InstrumentationPhase phase)
+	{
+		const auto now = Clock::now();
+		if (m_current != InstrumentationPhase::None)
+		{
+			m_times[static_cast<size_t>(m_current)] += now - m_phaseStart;
+		}
+		m_current = phase;
+		m_phaseStart = now;
+	}
+
+	std::array<uint64_t, static_cast<size_t>(InstrumentationCounter::Count)> m_counters;
+	std::array<Clock::duration, static_cast<size_t>(InstrumentationPhase::Count)> m_times;
+	InstrumentationPhase m_current;
+	Clock::time_point m_phaseStart;
+};
+
+template<>
+class Instrumentation<false>
+{
+public:
+	class ScopedPhase
+	{
+	public:
+		ScopedPhase(Instrumentation&, InstrumentationPhase)
+		{
+		}
+	};
+
+	void count(InstrumentationCounter, uint64_t = 1)
+	{
+	}
+
+	uint64_t counter(InstrumentationCounter) const
+	{
+		return 0;
+	}
+
+	double time(InstrumentationPhase) const
+	{
+		return 0.0;
+	}
+
+	void merge(const Instrumentation&)
+	{
+	}
+
+	void clear()
+	{
+	}
+};
+
+// {"enabled": true, "counters": {"iterations": 10, ...}, "seconds": {"crossover": 0.5, ...}}
+template<bool Enabled>
+void writeJson(std::ostream& stream, const Instrumentation<Enabled>& instrumentation)
+{
+	stream << "{\"enabled\": " << (Enabled ? "true" : "false") << ", \"counters\": {";
+	for (size_t i = 0; i < static_cast<size_t>(InstrumentationCounter::Count); i++)
+	{
+		const auto counter = static_cast<InstrumentationCounter>(i);
+		stream << (i > 0 ? ", " : "") << "\"" << detail::instrumentationName(counter) << "\": " << instrumentation.counter(counter);
+	}
+	stream << "}, \"seconds\": {";
+	for (size_t i = 0; i < static_cast<size_t>(InstrumentationPhase::Count); i++)
+	{
+		const auto phase = static_cast<InstrumentationPhase>(i);
+		stream << (i > 0 ? ", " : "") << "\"" << detail::instrumentationName(phase) << "\": " << instrumentation.time(phase);
+	}
+	stream << "}}";
+}
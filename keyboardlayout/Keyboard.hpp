@@ -2,6 +2,61 @@
 #include <array>
 #include <random>
 #include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "Random.hpp"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace detail
+{
+	// The Zobrist key of a key at a position. The keys are generated with splitmix64 instead of being stored in a table
+	inline uint64_t zobristKey(size_t position, size_t key)
+	{
+		uint64_t z = ((static_cast<uint64_t>(position) << 32) | key) + 0x9E3779B97F4A7C15ull;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	// The number of positions where the keys differ
+	template<size_t Size, typename KeyType>
+	size_t keyDistance(const KeyType* a, const KeyType* b)
+	{
+		size_t d = 0;
+		for (size_t i = 0; i < Size; i++)
+		{
+			d += a[i] != b[i];
+		}
+		return d;
+	}
+
+#if defined(__AVX2__)
+	// Compares 32 byte keys at a time. The equal keys are counted in byte lanes, which can't overflow since byte keys
+	// are only used for less than 256 positions, and summed with a sum of absolute differences
+	template<size_t Size>
+	size_t keyDistance(const unsigned char* a, const unsigned char* b)
+	{
+		__m256i equal = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 32 <= Size; i += 32)
+		{
+			const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+			const __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+			equal = _mm256_sub_epi8(equal, _mm256_cmpeq_epi8(x, y));
+		}
+		alignas(32) uint64_t sums[4];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(sums), _mm256_sad_epu8(equal, _mm256_setzero_si256()));
+		size_t d = i - static_cast<size_t>(sums[0] + sums[1] + sums[2] + sums[3]);
+		for (; i < Size; i++)
+		{
+			d += a[i] != b[i];
+		}
+		return d;
+	}
+#endif
+}
 
 template<size_t Size, bool small = (Size < 256)>
 struct KeyTypeHelper
@@ -38,9 +93,17 @@ public:
 	{
 	}
 
-	void randomize(std::mt19937& randomGenerator)
+	template<typename RandomGenerator>
+	void randomize(RandomGenerator& randomGenerator)
+	{
+		detail::shuffle(m_keys.begin(), m_keys.end(), randomGenerator);
+	}
+
+	// Shuffles the keys of the first count positions, the rest keep their keys
+	template<typename RandomGenerator>
+	void randomize(RandomGenerator& randomGenerator, size_t count)
 	{
-		std::shuffle(m_keys.begin(), m_keys.end(), randomGenerator);
+		detail::shuffle(m_keys.begin(), m_keys.begin() + count, randomGenerator);
 	}
 
 	bool operator==(const Keyboard& rhs) const
@@ -53,5 +116,29 @@ public:
 		return !(*this == rhs);
 	}
 
+	// The Zobrist hash of the keyboard
+	uint64_t hash() const
+	{
+		uint64_t h = 0;
+		for (size_t i = 0; i < Size; i++)
+		{
+			h ^= detail::zobristKey(i, m_keys[i]);
+		}
+		return h;
+	}
+
+	// The hash the keyboard will have after swapping the keys at positions i and j, given its current hash
+	uint64_t swappedHash(uint64_t hash, size_t i, size_t j) const
+	{
+		return hash ^ detail::zobristKey(i, m_keys[i]) ^ detail::zobristKey(j, m_keys[j]) ^
+			detail::zobristKey(i, m_keys[j]) ^ detail::zobristKey(j, m_keys[i]);
+	}
+
+	// The Hamming distance, the number of positions with different keys
+	size_t distance(const Keyboard& rhs) const
+	{
+		return detail::keyDistance<Size>(m_keys.data(), rhs.m_keys.data());
+	}
+
 	std::array<KeyType, Size> m_keys;
 };
\ No newline at end of file
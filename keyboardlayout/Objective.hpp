@@ -1,17 +1,93 @@
 #pragma once
+#include <array>
+#include <limits>
+#include <tuple>
+#include <memory>
+#include <type_traits>
 
 template<size_t KeyboardSize>
 class Keyboard;
 
+namespace detail
+{
+	// The cost type of an objective is either floating point, where costs are compared with a small tolerance,
+	// or an integer type for objectives with integer costs, where the comparisons are exact
+	template<typename Cost, bool Exact = std::is_integral<Cost>::value>
+	struct CostTraits
+	{
+		// The type used for the ratios of costs
+		typedef Cost Real;
+		// Whether the deltas updated move by move are identical to the deltas computed from scratch
+		static constexpr bool IsExact = false;
+
+		static Cost tolerance()
+		{
+			return static_cast<Cost>(0.0000001f);
+		}
+
+		// A cost is an improvement when it's bigger than the threshold
+		static Cost improvementThreshold(Cost reference)
+		{
+			return reference + tolerance();
+		}
+
+		static bool isImprovement(Cost cost, Cost reference)
+		{
+			return cost > improvementThreshold(reference);
+		}
+
+		static bool isBelowTarget(Cost cost, Cost target)
+		{
+			return target - cost > tolerance();
+		}
+	};
+
+	template<typename Cost>
+	struct CostTraits<Cost, true>
+	{
+		typedef double Real;
+		static constexpr bool IsExact = true;
+
+		static Cost tolerance()
+		{
+			return 0;
+		}
+
+		static Cost improvementThreshold(Cost reference)
+		{
+			return reference;
+		}
+
+		static bool isImprovement(Cost cost, Cost reference)
+		{
+			return cost > reference;
+		}
+
+		static bool isBelowTarget(Cost cost, Cost target)
+		{
+			return cost < target;
+		}
+	};
+}
+
 template<size_t KeyboardSize, typename FloatingPoint = float>
 class Objective
 {
 public:
 	using floating_point_t = FloatingPoint;
 	static const size_t NoSwap = std::numeric_limits<size_t>::max();
+	typedef std::array<std::array<FloatingPoint, KeyboardSize>, KeyboardSize> DeltaArray;
+	typedef std::tuple<size_t, size_t, FloatingPoint> Move;
 
 	virtual FloatingPoint evaluate(const Keyboard<KeyboardSize>& keyboard) const = 0;
 
+	// The number of locations the search moves the keys between. An objective that pads a smaller instance to
+	// KeyboardSize returns the size of the instance, and the dummy keys stay at the dummy positions after it
+	virtual size_t numLocations() const
+	{
+		return KeyboardSize;
+	}
+
 	void evaluateFirstNeighbourhood(const Keyboard<KeyboardSize>& keyboard, FloatingPoint v, std::array<std::array<FloatingPoint, KeyboardSize>, KeyboardSize>& delta) const
 	{
 		evaluateNeighbourhood(keyboard, v, NoSwap, NoSwap, delta);
@@ -29,4 +105,68 @@ public:
 			}
 		}
 	}
+
+	// Updates the neighbourhood like evaluateNeighbourhood, and returns the move with the biggest delta
+	// Objectives can override this to select the move in the same pass as the update
+	virtual Move evaluateNeighbourhoodBestMove(const Keyboard<KeyboardSize>& keyboard, FloatingPoint v, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta) const
+	{
+		evaluateNeighbourhood(keyboard, v, lastSwapI, lastSwapJ, delta);
+		Move best = std::make_tuple(NoSwap, NoSwap, std::numeric_limits<FloatingPoint>::lowest());
+		const size_t n = numLocations();
+		for (size_t i = 0; i < n; i++)
+		{
+			selectBestMove(delta[i].data(), i, i + 1, best, n);
+		}
+		return best;
+	}
+
+	// Scratch space that an objective can keep in sync with the keyboard of one local search.
+	// It's created once per search and passed to every neighbourhood update of that search.
+	class SearchState
+	{
+	public:
+		virtual ~SearchState()
+		{
+		}
+	};
+
+	virtual std::unique_ptr<SearchState> createSearchState() const
+	{
+		return nullptr;
+	}
+
+	virtual Move evaluateNeighbourhoodBestMove(const Keyboard<KeyboardSize>& keyboard, FloatingPoint v, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta, SearchState* searchState) const
+	{
+		return evaluateNeighbourhoodBestMove(keyboard, v, lastSwapI, lastSwapJ, delta);
+	}
+
+	// The delta of swapping the locations i and j, for the searches that don't keep a delta matrix. The search state
+	// follows the keyboard like in evaluateNeighbourhoodBestMove, so lastSwapI and lastSwapJ are the swap made to the
+	// keyboard since the previous call with the state
+	virtual FloatingPoint evaluateMove(const Keyboard<KeyboardSize>& keyboard, FloatingPoint v, size_t lastSwapI, size_t lastSwapJ, size_t i, size_t j, SearchState* searchState) const
+	{
+		Keyboard<KeyboardSize> k = keyboard;
+		std::swap(k.m_keys[i], k.m_keys[j]);
+		return evaluate(k) - v;
+	}
+
+protected:
+	// Only the moves to the locations before end are selected
+	static void selectBestMove(const FloatingPoint* row, size_t i, size_t from, Move& best, size_t end = KeyboardSize)
+	{
+		FloatingPoint maxDelta = std::get<2>(best);
+		size_t jRetained = KeyboardSize;
+		for (size_t j = from; j < end; j++)
+		{
+			if (row[j] > maxDelta)
+			{
+				maxDelta = row[j];
+				jRetained = j;
+			}
+		}
+		if (jRetained != KeyboardSize)
+		{
+			best = std::make_tuple(i, jRetained, maxDelta);
+		}
+	}
 };
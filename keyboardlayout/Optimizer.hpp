@@ -7,6 +7,8 @@
 #include <utility>
 #include <numeric>
 #include <boost/math/special_functions/binomial.hpp>
+#include "Budget.hpp"
+#include "Random.hpp"
 
 template<size_t KeyboardSize, typename FloatingPoint>
 class Objective;
@@ -43,7 +45,6 @@ namespace detail
 		std::array<bool, Size> unassignedChildPos;
 		unassigned.fill(true);
 		unassignedChildPos.fill(true);
-		std::bernoulli_distribution dist;
 		Keyboard<Size> ret;
 		bool assigned = true;
 
@@ -58,7 +59,7 @@ namespace detail
 			}
 			else if (unassigned[p1] && unassigned[p2])
 			{
-				if (dist(generator))
+				if (detail::randomBool(generator))
 				{
 					s = p1;
 				}
@@ -101,7 +102,7 @@ namespace detail
 			}
 		}
 
-		std::shuffle(keysleft.begin(), itr, generator);
+		detail::shuffle(keysleft.begin(), itr, generator);
 		itr = keysleft.begin();
 		for (size_t i = 0; i < Size; i++)
 		{
@@ -146,8 +147,8 @@ namespace detail
 		}
 	}
 
-	template<typename T>
-	inline void generateWeightVectors(T& output, size_t populationSize, size_t numObjectives, std::mt19937* randomGenerator = nullptr)
+	template<typename T, typename RandomGenerator = std::mt19937>
+	inline void generateWeightVectors(T& output, size_t populationSize, size_t numObjectives, RandomGenerator* randomGenerator = nullptr)
 	{
 		output.reserve(populationSize);
 		if (populationSize == 1)
@@ -171,14 +172,14 @@ namespace detail
 			generateWeightVectorsHelper(output, h + 1, numObjectives, 0, 0, 1, current);
 			if (output.size() > populationSize)
 			{
-				std::unique_ptr<std::mt19937> g;
+				std::unique_ptr<RandomGenerator> g;
 				if (!randomGenerator)
 				{
 					std::random_device rd;
-					g = std::make_unique<std::mt19937>(rd());
+					g = std::make_unique<RandomGenerator>(randomStream<RandomGenerator>(rd(), 0));
 					randomGenerator = g.get();
 				}
-				std::shuffle(output.begin(), output.end(), *randomGenerator);
+				detail::shuffle(output.begin(), output.end(), *randomGenerator);
 				output.erase(output.begin() + populationSize, output.end());
 			}
 		}
@@ -237,14 +238,15 @@ namespace detail
 	}
 }
 
-template<size_t KeyboardSize, size_t NumObjectives, size_t MaxLeafSize = std::numeric_limits<size_t>::max()>
+// RandomGenerator is Xoshiro256StarStar, Philox4x32 or a standard engine with a full range of 32 or 64 bits
+template<size_t KeyboardSize, size_t NumObjectives, size_t MaxLeafSize = std::numeric_limits<size_t>::max(), typename RandomGenerator = Xoshiro256StarStar>
 class Optimizer
 {
 	static std::random_device rd;
 public:
-	Optimizer(unsigned int seed = Optimizer::rd())
+	Optimizer(unsigned int seed = Optimizer::rd()) :
+		m_randomGenerator(detail::randomStream<RandomGenerator>(seed, 0))
 	{
-		m_randomGenerator.seed(seed);
 	}
 
 	void populationSize(size_t size)
@@ -274,6 +276,24 @@ public:
 		m_useParetoDominance = true;
 	}
 
+	// The limit in seconds of process CPU time
+	void maxTime(double t)
+	{
+		m_budget.cpuTime(t);
+	}
+
+	// The limit in seconds of wall clock time
+	void maxWallTime(double t)
+	{
+		m_budget.wallTime(t);
+	}
+
+	// The optimization stops as soon as the flag is set
+	void stopFlag(const std::atomic<bool>* stop)
+	{
+		m_budget.stopFlag(stop);
+	}
+
 	template<typename Solution, typename Itr>
 	void evaluate(Solution& solution, Keyboard<KeyboardSize>& keyboard, Itr begin, Itr end)
 	{
@@ -292,6 +312,8 @@ public:
 		// "A Simulated Annealing based Genetic Local Search Algorithm for Multi-objective Multicast Routing Problems"
 
 		selectWeightVectors(end - begin);
+		// The objectives of a run are built from the same instance
+		m_numLocations = begin != end ? begin->numLocations() : KeyboardSize;
 		std::vector<float> solution;
 		solution.resize(end - begin);
 		m_population.resize(m_populationSize);
@@ -300,14 +322,15 @@ public:
 
 		for (auto i = 0; i < m_populationSize; i++)
 		{
-			m_population[i].randomize(m_randomGenerator);
+			m_population[i].randomize(m_randomGenerator, m_numLocations);
 			m_populationSolutions[i].resize(end - begin);
 			Keyboard<KeyboardSize> keyboard = m_population[i];
 			evaluate(m_populationSolutions[i], keyboard, begin, end);
 		}
 		m_NonDominatedSet = NonDominatedSet<KeyboardSize, NumObjectives, MaxLeafSize>(m_population, m_populationSolutions);
 		
-		int numEvaluationsLeft = static_cast<int>(numEvaluations);
+		m_budget.evaluations(numEvaluations);
+		m_budget.start();
 		m_minT = m_initialMinT;
 		m_maxT = m_initialMaxT;
 		m_numTSteps = m_initialTSteps;
@@ -317,8 +340,8 @@ public:
 			simulatedAnnealing(i, begin, end, newKeyboard, solution, detail::weightedSum, false);
 			m_population[i] = newKeyboard;
 			std::swap(m_populationSolutions[i], solution);
-			numEvaluationsLeft -= static_cast<int>(m_numTSteps);
-			if (numEvaluationsLeft < 0)
+			m_budget.consume(m_numTSteps);
+			if (m_budget.exhaustedNow())
 				break;
 		}
 
@@ -326,19 +349,16 @@ public:
 		m_maxT = m_fastCoolingMaxT;
 		m_numTSteps = m_fastCoolingTSteps;
 		
-		while(numEvaluationsLeft > 0)
+		while(!m_budget.exhaustedNow())
 		{
-			auto selector = std::uniform_int<size_t>(0, m_NonDominatedSet.size() - 1);
-			auto index = selector(m_randomGenerator);
+			auto index = detail::randomIndex(m_randomGenerator, m_NonDominatedSet.size());
 			const auto& selectedSolution = m_NonDominatedSet[index];
 			m_population[0] = selectedSolution.m_keyboard;
 			m_populationSolutions[0].assign(std::begin(selectedSolution.m_solution), std::end(selectedSolution.m_solution));
 
 			typedef std::vector<float> V;
-			auto objectiveSelector = std::uniform_int<size_t>(0, NumObjectives - 1);
-			auto obj = objectiveSelector(m_randomGenerator);
-			auto directionSelector = std::bernoulli_distribution();
-			auto direction = directionSelector(m_randomGenerator);
+			auto obj = detail::randomIndex(m_randomGenerator, NumObjectives);
+			auto direction = detail::randomBool(m_randomGenerator);
 			auto scalarize = [obj, direction] (const V& solution, const V&, const V&)
 			{
 				if (direction)
@@ -353,7 +373,7 @@ public:
 
 			Keyboard<KeyboardSize> newKeyboard;
 			simulatedAnnealing(0, begin, end, newKeyboard, solution, scalarize, m_useParetoDominance);
-			numEvaluationsLeft -= static_cast<int>(m_numTSteps);
+			m_budget.consume(m_numTSteps);
 		}
 		return m_NonDominatedSet;
 	}
@@ -362,7 +382,6 @@ protected:
 	template<typename Itr, typename ScalarizeFunc>
 	void simulatedAnnealing(size_t index, Itr begin, Itr end, Keyboard<KeyboardSize>& outKeyboard, std::vector<float>& prevSolution, ScalarizeFunc& scalarize, bool paretoDominance)
 	{
-		auto probability = std::uniform_real_distribution<float>(0, 1.0);
 		outKeyboard = m_population[index];
 		prevSolution = m_populationSolutions[index];
 		float alpha = std::pow(m_minT / m_maxT, 1.0f / m_numTSteps);
@@ -387,7 +406,7 @@ protected:
 				dominated = true;
 			}
 
-			if (annealingProbability(prevSolution, m_currentSolution, m_weights[index], currentT, scalarize) > probability(m_randomGenerator) || dominating || paretoFront)
+			if (annealingProbability(prevSolution, m_currentSolution, m_weights[index], currentT, scalarize) > detail::randomFloat(m_randomGenerator) || dominating || paretoFront)
 			{
 				bool paretoValid = true;
 				if (paretoDominance)
@@ -401,7 +420,7 @@ protected:
 					{
 						float energy = dominated ? 1.0f : m_paretoEqualMultiplier;
 						float p = std::exp(-(energy / paretoCurrentT));
-						if (p > probability(m_randomGenerator))
+						if (p > detail::randomFloat(m_randomGenerator))
 						{
 							paretoValid = true;
 						}
@@ -446,12 +465,11 @@ protected:
 
 	size_t selectParent(std::vector<float>& fitnesses)
 	{
-		auto parentSelector = std::uniform_int_distribution<>(0, PopulationSize - 1);
-		auto parent1 = parentSelector(m_randomGenerator);
-		auto parent2 = parentSelector(m_randomGenerator);
+		auto parent1 = detail::randomIndex(m_randomGenerator, m_populationSize);
+		auto parent2 = detail::randomIndex(m_randomGenerator, m_populationSize);
 		while (parent2 == parent1)
 		{
-			parent2 = parentSelector(m_randomGenerator);
+			parent2 = detail::randomIndex(m_randomGenerator, m_populationSize);
 		}
 		if (fitnesses[parent1] > fitnesses[parent2])
 		{
@@ -476,9 +494,8 @@ protected:
 
 	Keyboard<KeyboardSize> produceChild(const Keyboard<KeyboardSize>& parent1, const Keyboard<KeyboardSize>& parent2)
 	{
-		auto dist = std::uniform_int_distribution<size_t>(0, parent1.m_keys.size()-1);
-		auto p1 = dist(m_randomGenerator);
-		auto p2 = dist(m_randomGenerator);
+		auto p1 = detail::randomIndex(m_randomGenerator, m_numLocations);
+		auto p2 = detail::randomIndex(m_randomGenerator, m_numLocations);
 		if (p2 < p1)
 		{
 			std::swap(p1, p2);
@@ -489,21 +506,22 @@ protected:
 	Keyboard<KeyboardSize> mutate(const Keyboard<KeyboardSize>& keyboard)
 	{
 		Keyboard<KeyboardSize> ret = keyboard;
-		auto dist = std::uniform_int_distribution<size_t>(0, keyboard.m_keys.size()-1);
-		auto k1 = dist(m_randomGenerator);
-		auto k2 = dist(m_randomGenerator);
+		auto k1 = detail::randomIndex(m_randomGenerator, m_numLocations);
+		auto k2 = detail::randomIndex(m_randomGenerator, m_numLocations);
 		std::swap(ret.m_keys[k1], ret.m_keys[k2]);
 		return ret;
 	}
 
 
-	std::mt19937 m_randomGenerator;
+	RandomGenerator m_randomGenerator;
 	NonDominatedSet<KeyboardSize, NumObjectives, MaxLeafSize> m_NonDominatedSet;
 	std::vector<Keyboard<KeyboardSize>> m_population;
 	std::vector<std::vector<float>> m_populationSolutions;
 	std::vector<std::vector<float>> m_weights;
 	std::vector<float> m_currentSolution;
 	size_t m_populationSize = 0;
+	// The locations of the objectives, the keys after them are padding
+	size_t m_numLocations = KeyboardSize;
 	float m_initialMaxT = 1.0f;
 	float m_initialMinT = 0.1f;
 	size_t m_initialTSteps = 10;
@@ -514,6 +532,7 @@ protected:
 	float m_paretoMinT = 0.1f;
 	float m_paretoEqualMultiplier = 0.5f;
 	bool m_useParetoDominance = false;
+	Budget<> m_budget;
 
 
 	float m_maxT;
@@ -521,5 +540,5 @@ protected:
 	size_t m_numTSteps;
 };
 
-template<size_t KeyboardSize, size_t NumObjectives, size_t MaxLeafSize>
-std::random_device Optimizer<KeyboardSize, NumObjectives, MaxLeafSize>::rd;
\ No newline at end of file
+template<size_t KeyboardSize, size_t NumObjectives, size_t MaxLeafSize, typename RandomGenerator>
+std::random_device Optimizer<KeyboardSize, NumObjectives, MaxLeafSize, RandomGenerator>::rd;
\ No newline at end of file
@@ -1,104 +1,786 @@
 #pragma once
-#include <fstream>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
 #include "Objective.hpp"
+#include "QAPKernels.hpp"
+#include "InstanceLoader.hpp"
+#include "ThreadPool.hpp"
+
+enum class QAPStorage
+{
+	Automatic,
+	Dense,
+	Sparse,
+};
 
 template<size_t NumLocations, typename FloatingPoint = double>
 class QAP : public Objective<NumLocations, FloatingPoint>
 {
+	typedef Objective<NumLocations, FloatingPoint> Base;
 public:
-	QAP(const std::string& filename)
+	typedef typename Base::DeltaArray DeltaArray;
+	typedef typename Base::Move Move;
+
+	// Below this fraction of non zeros in the first matrix, the automatic storage uses the sparse kernels
+	static constexpr double SparseDensityThreshold = 0.25;
+	// The smallest instances for which the initial neighbourhood is split between threads
+	static const size_t ParallelMinLocations = 128;
+
+	QAP(const std::string& filename, QAPStorage storage = QAPStorage::Automatic)
+		: QAP(detail::loadQAPInstance(filename), storage)
 	{
-		std::ifstream stream(filename);
-		int numLocations;
-		stream >> numLocations;
-		for (size_t i = 0; i < NumLocations; i++)
+	}
+
+	QAP(const detail::QAPInstance& instance, QAPStorage storage = QAPStorage::Automatic)
+	{
+		const size_t numLocations = instance.m_numLocations;
+		if (numLocations > NumLocations)
+		{
+			throw std::invalid_argument("The QAP instance has more locations than the objective");
+		}
+		// Smaller instances are padded with dummy locations that have no distances or flows, which doesn't change the cost
+		// as long as the dummy keys stay at the dummy positions
+		std::vector<int64_t> distances(NumLocations * NumLocations, 0);
+		std::vector<int64_t> flow(NumLocations * NumLocations, 0);
+		for (size_t i = 0; i < numLocations; i++)
 		{
-			for (size_t j = 0; j < NumLocations; j++)
+			for (size_t j = 0; j < numLocations; j++)
 			{
-				stream >> m_distances[i][j];
+				distances[i * NumLocations + j] = instance.distance(i, j);
+				flow[i * NumLocations + j] = instance.flow(i, j);
 			}
 		}
+		m_numLocations = numLocations;
+		m_symmetric = isSymmetric(distances) && isSymmetric(flow);
+
+		if (numLocations == NumLocations)
+		{
+			// The instance is already stored with the narrowest type, so its storage is used directly, which for a cache file is shared with the other processes
+			m_valueType = instance.m_valueType;
+			m_distances = instance.m_distances;
+			m_flow = instance.m_flow;
+			m_storage = instance.m_storage;
+		}
+		else
+		{
+			storeMatrices(distances, flow);
+		}
+
+		// The first matrix is indexed by location, so when it's sparse only the few non zero partners of the swapped locations need to be visited
+		const size_t nonZeros = distances.size() - std::count(distances.begin(), distances.end(), 0);
+		const double density = static_cast<double>(nonZeros) / (NumLocations * NumLocations);
+		m_sparse = storage == QAPStorage::Sparse || (storage == QAPStorage::Automatic && density < SparseDensityThreshold);
+		if (m_sparse)
+		{
+			m_sparseRows = detail::QAPSparseMatrix::fromDense<NumLocations>(distances, false);
+			m_sparseColumns = detail::QAPSparseMatrix::fromDense<NumLocations>(distances, true);
+		}
+		else if (!m_symmetric)
+		{
+			transposeDistances();
+		}
+	}
+
+	// The number of threads used for building the initial neighbourhood of large dense instances
+	void threads(size_t numThreads)
+	{
+		threadPool(numThreads > 1 ? std::make_shared<detail::ThreadPool>(numThreads) : nullptr);
+	}
+
+	// Builds the initial neighbourhoods on the threads of a pool shared with the optimizer. The searches that already
+	// run on the threads of the pool build them on their own thread
+	void threadPool(std::shared_ptr<detail::ThreadPool> pool)
+	{
+		m_threadPool = std::move(pool);
+	}
+
+	bool isSparse() const
+	{
+		return m_sparse;
+	}
+
+	// The number of locations in the instance, the rest up to NumLocations are padding. The best moves are only
+	// selected between these locations, since moving a facility to a dummy location would drop its cost
+	size_t numLocations() const override
+	{
+		return m_numLocations;
+	}
+
+	FloatingPoint evaluate(const Keyboard<NumLocations>& keyboard) const override
+	{
+		// TODO it seems like the flow and distances are the wrong way around
+		int64_t sum;
+		switch (m_valueType)
+		{
+		case detail::QAPValueType::Int8:
+			sum = m_sparse ? evaluateSparse<int8_t>(keyboard) : evaluateMatrices<int8_t>(keyboard);
+			break;
+		case detail::QAPValueType::Int16:
+			sum = m_sparse ? evaluateSparse<int16_t>(keyboard) : evaluateMatrices<int16_t>(keyboard);
+			break;
+		case detail::QAPValueType::Int32:
+			sum = m_sparse ? evaluateSparse<int32_t>(keyboard) : evaluateMatrices<int32_t>(keyboard);
+			break;
+		default:
+			sum = m_sparse ? evaluateSparse<int64_t>(keyboard) : evaluateMatrices<int64_t>(keyboard);
+			break;
+		}
+		return -static_cast<FloatingPoint>(static_cast<uint64_t>(sum));
+	}
+	
+	// Without a search state the flow is read through the keyboard, so a single update doesn't build the permuted flow
+	virtual void evaluateNeighbourhood(const Keyboard<NumLocations>& keyboard, FloatingPoint v, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta) const override
+	{
+		dispatchSymmetry<false>(keyboard, lastSwapI, lastSwapJ, delta, nullptr);
+	}
+
+	virtual Move evaluateNeighbourhoodBestMove(const Keyboard<NumLocations>& keyboard, FloatingPoint v, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta) const override
+	{
+		return dispatchSymmetry<true>(keyboard, lastSwapI, lastSwapJ, delta, nullptr);
+	}
+
+	virtual std::unique_ptr<typename Base::SearchState> createSearchState() const override
+	{
+		return std::unique_ptr<typename Base::SearchState>(new PermutedFlow());
+	}
+
+	virtual Move evaluateNeighbourhoodBestMove(const Keyboard<NumLocations>& keyboard, FloatingPoint v, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta, typename Base::SearchState* searchState) const override
+	{
+		if (!searchState)
+		{
+			return evaluateNeighbourhoodBestMove(keyboard, v, lastSwapI, lastSwapJ, delta);
+		}
+		return dispatchSymmetry<true>(keyboard, lastSwapI, lastSwapJ, delta, static_cast<PermutedFlow*>(searchState));
+	}
+
+	// O(n), with the permuted flow of the search state or through the keyboard without one
+	virtual FloatingPoint evaluateMove(const Keyboard<NumLocations>& keyboard, FloatingPoint v, size_t lastSwapI, size_t lastSwapJ, size_t i, size_t j, typename Base::SearchState* searchState) const override
+	{
+		PermutedFlow* state = static_cast<PermutedFlow*>(searchState);
+		switch (m_valueType)
+		{
+		case detail::QAPValueType::Int8:
+			return moveDelta<int8_t>(keyboard, lastSwapI, lastSwapJ, i, j, state);
+		case detail::QAPValueType::Int16:
+			return moveDelta<int16_t>(keyboard, lastSwapI, lastSwapJ, i, j, state);
+		case detail::QAPValueType::Int32:
+			return moveDelta<int32_t>(keyboard, lastSwapI, lastSwapJ, i, j, state);
+		default:
+			return moveDelta<int64_t>(keyboard, lastSwapI, lastSwapJ, i, j, state);
+		}
+	}
+
+private:
+	typedef std::array<int64_t, NumLocations> Vector;
+	typedef typename Keyboard<NumLocations>::KeyType KeyType;
+	template<typename T>
+	using LookupView = detail::QAPPermutedMatrixView<NumLocations, T, KeyType>;
+
+	// The flow matrix permuted by the keyboard of the search, bp[i][j] = b[p[i]][p[j]], so that the delta kernels can read it row by row.
+	// A swap of two locations only swaps two rows and two columns of it.
+	class PermutedFlow : public Base::SearchState
+	{
+	public:
+		std::vector<uint8_t> m_flow;
+		Keyboard<NumLocations> m_keyboard;
+		bool m_valid = false;
+		// Scratch space of the initial neighbourhood
+		std::vector<uint8_t> m_flowTransposed;
+		std::vector<int64_t> m_products;
+	};
+
+	template<typename T>
+	void transposeDistancesAs()
+	{
+		m_distancesTransposed.assign(NumLocations * NumLocations * sizeof(T) + detail::QAPMatrixPadding, 0);
+		detail::qapTranspose<NumLocations>(reinterpret_cast<const T*>(m_distances), reinterpret_cast<T*>(m_distancesTransposed.data()));
+	}
+
+	void transposeDistances()
+	{
+		switch (m_valueType)
+		{
+		case detail::QAPValueType::Int8:
+			transposeDistancesAs<int8_t>();
+			break;
+		case detail::QAPValueType::Int16:
+			transposeDistancesAs<int16_t>();
+			break;
+		case detail::QAPValueType::Int32:
+			transposeDistancesAs<int32_t>();
+			break;
+		default:
+			transposeDistancesAs<int64_t>();
+			break;
+		}
+	}
+
+	// Store the matrices with the narrowest type that can hold all the values, to keep the working set of the delta updates in the cache
+	void storeMatrices(const std::vector<int64_t>& distances, const std::vector<int64_t>& flow)
+	{
+		auto distanceRange = std::minmax_element(distances.begin(), distances.end());
+		auto flowRange = std::minmax_element(flow.begin(), flow.end());
+		m_valueType = detail::qapSelectValueType(
+			std::min(*distanceRange.first, *flowRange.first), std::max(*distanceRange.second, *flowRange.second));
+		detail::QAPInstance padded;
+		uint8_t* a = detail::allocateQAPInstance(padded, NumLocations, m_valueType);
+		uint8_t* b = a + detail::qapMatrixBytes(NumLocations, m_valueType);
+		for (size_t i = 0; i < NumLocations * NumLocations; i++)
+		{
+			detail::qapStoreValue(a, m_valueType, i, distances[i]);
+			detail::qapStoreValue(b, m_valueType, i, flow[i]);
+		}
+		m_distances = padded.m_distances;
+		m_flow = padded.m_flow;
+		m_storage = padded.m_storage;
+	}
+
+	template<typename T>
+	detail::QAPMatrixView<NumLocations, T> distanceMatrix() const
+	{
+		return detail::QAPMatrixView<NumLocations, T>(reinterpret_cast<const T*>(m_distances));
+	}
+
+	template<typename T>
+	detail::QAPMatrixView<NumLocations, T> flowMatrix() const
+	{
+		return detail::QAPMatrixView<NumLocations, T>(reinterpret_cast<const T*>(m_flow));
+	}
+
+	// Brings the permuted flow up to date with the keyboard, which has already had the locations r and s swapped.
+	// The state is rebuilt when it's new or when it doesn't match the keyboard.
+	template<typename T>
+	detail::QAPMatrixView<NumLocations, T> updatePermutedFlow(const Keyboard<NumLocations>& keyboard, size_t r, size_t s, PermutedFlow& state) const
+	{
+		const size_t n = NumLocations;
+		if (state.m_valid && r != Base::NoSwap && s != Base::NoSwap)
+		{
+			T* bp = reinterpret_cast<T*>(state.m_flow.data());
+			std::swap_ranges(bp + r * n, bp + (r + 1) * n, bp + s * n);
+			for (size_t k = 0; k < n; k++)
+			{
+				std::swap(bp[k * n + r], bp[k * n + s]);
+			}
+			std::swap(state.m_keyboard.m_keys[r], state.m_keyboard.m_keys[s]);
+		}
+		if (!state.m_valid || !(state.m_keyboard == keyboard))
+		{
+			state.m_flow.resize(n * n * sizeof(T) + detail::QAPMatrixPadding);
+			T* bp = reinterpret_cast<T*>(state.m_flow.data());
+			auto b = flowMatrix<T>();
+			auto& p = keyboard.m_keys;
+			for (size_t i = 0; i < n; i++)
+			{
+				const T* flowRow = b[p[i]].data();
+				for (size_t j = 0; j < n; j++)
+				{
+					bp[i * n + j] = flowRow[p[j]];
+				}
+			}
+			state.m_keyboard = keyboard;
+			state.m_valid = true;
+		}
+		return detail::QAPMatrixView<NumLocations, T>(reinterpret_cast<const T*>(state.m_flow.data()));
+	}
+
+	template<typename T>
+	LookupView<T> lookupFlow(const Keyboard<NumLocations>& keyboard) const
+	{
+		return LookupView<T>(flowMatrix<T>().data(), keyboard.m_keys.data());
+	}
+
+	template<typename T>
+	static int64_t rowDot(const T* x, const typename detail::QAPMatrixView<NumLocations, T>::Row& row)
+	{
+		return detail::QAPEvaluateKernel<NumLocations, T>::dot(x, row.data());
+	}
+
+	template<typename T>
+	static int64_t rowDot(const T* x, const typename LookupView<T>::Row& row)
+	{
+		return row.dot(x);
+	}
+
+	template<typename T>
+	int64_t evaluateMatrices(const Keyboard<NumLocations>& keyboard) const
+	{
+		auto a = distanceMatrix<T>();
+		auto b = flowMatrix<T>();
+		const auto* keys = keyboard.m_keys.data();
+		int64_t sum = 0;
+		for (size_t i = 0; i < NumLocations; i++)
+		{
+			sum += detail::QAPEvaluateKernel<NumLocations, T>::evaluateRow(a[i].data(), b[keys[i]].data(), keys);
+		}
+		return sum;
+	}
+
+	template<typename T>
+	int64_t evaluateSparse(const Keyboard<NumLocations>& keyboard) const
+	{
+		auto b = flowMatrix<T>();
+		auto& p = keyboard.m_keys;
+		auto& m = m_sparseRows;
+		int64_t sum = 0;
 		for (size_t i = 0; i < NumLocations; i++)
 		{
-			for (size_t j = 0; j < NumLocations; j++)
+			auto flowRow = b[p[i]];
+			for (uint32_t e = m.m_start[i]; e < m.m_start[i + 1]; e++)
 			{
-				stream >> m_flow[i][j];
+				sum += m.m_value[e] * flowRow[p[m.m_index[e]]];
 			}
 		}
+		return sum;
 	}
 
-	FloatingPoint evaluate(const Keyboard<NumLocations>& keyboard) const override
+	template<typename T>
+	FloatingPoint moveDelta(const Keyboard<NumLocations>& keyboard, size_t lastSwapI, size_t lastSwapJ, size_t i, size_t j, PermutedFlow* state) const
+	{
+		if (!state)
+		{
+			return moveDelta<T>(lookupFlow<T>(keyboard), i, j);
+		}
+		return moveDelta<T>(updatePermutedFlow<T>(keyboard, lastSwapI, lastSwapJ, *state), i, j);
+	}
+
+	template<typename T, typename FlowView>
+	FloatingPoint moveDelta(const FlowView& bp, size_t i, size_t j) const
+	{
+		int64_t d;
+		if (m_sparse)
+		{
+			d = m_symmetric ? computeSparseDelta<true, T>(bp, i, j) : computeSparseDelta<false, T>(bp, i, j);
+		}
+		else
+		{
+			d = m_symmetric ? computeDelta<true, T>(bp, i, j) : computeDelta<false, T>(bp, i, j);
+		}
+		return -static_cast<FloatingPoint>(d);
+	}
+
+	template<bool SelectBestMove>
+	Move dispatchSymmetry(const Keyboard<NumLocations>& keyboard, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta, PermutedFlow* state) const
 	{
-		uint64_t sum = 0;
+		if (m_symmetric)
+		{
+			return dispatchValueType<SelectBestMove, true>(keyboard, lastSwapI, lastSwapJ, delta, state);
+		}
+		return dispatchValueType<SelectBestMove, false>(keyboard, lastSwapI, lastSwapJ, delta, state);
+	}
+
+	template<bool SelectBestMove, bool Symmetric>
+	Move dispatchValueType(const Keyboard<NumLocations>& keyboard, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta, PermutedFlow* state) const
+	{
+		switch (m_valueType)
+		{
+		case detail::QAPValueType::Int8:
+			return dispatchStorage<SelectBestMove, Symmetric, int8_t>(keyboard, lastSwapI, lastSwapJ, delta, state);
+		case detail::QAPValueType::Int16:
+			return dispatchStorage<SelectBestMove, Symmetric, int16_t>(keyboard, lastSwapI, lastSwapJ, delta, state);
+		case detail::QAPValueType::Int32:
+			return dispatchStorage<SelectBestMove, Symmetric, int32_t>(keyboard, lastSwapI, lastSwapJ, delta, state);
+		default:
+			return dispatchStorage<SelectBestMove, Symmetric, int64_t>(keyboard, lastSwapI, lastSwapJ, delta, state);
+		}
+	}
+
+	template<bool SelectBestMove, bool Symmetric, typename T>
+	Move dispatchStorage(const Keyboard<NumLocations>& keyboard, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta, PermutedFlow* state) const
+	{
+		if (!state)
+		{
+			auto b = lookupFlow<T>(keyboard);
+			if (m_sparse)
+			{
+				return updateSparseNeighbourhood<SelectBestMove, Symmetric, T>(b, lastSwapI, lastSwapJ, delta);
+			}
+			return updateNeighbourhood<SelectBestMove, Symmetric, T>(b, lastSwapI, lastSwapJ, delta);
+		}
+		auto bp = updatePermutedFlow<T>(keyboard, lastSwapI, lastSwapJ, *state);
+		if (m_sparse)
+		{
+			return updateSparseNeighbourhood<SelectBestMove, Symmetric, T>(bp, lastSwapI, lastSwapJ, delta);
+		}
+		if (lastSwapI == Base::NoSwap || lastSwapJ == Base::NoSwap)
+		{
+			return initialNeighbourhood<SelectBestMove, Symmetric, T>(bp, delta, *state);
+		}
+		return updateNeighbourhood<SelectBestMove, Symmetric, T>(bp, lastSwapI, lastSwapJ, delta);
+	}
+
+	// Computes the full neighbourhood from the matrix products M = A * BP^T and, for asymmetric instances, N = A^T * BP, which turns the
+	// O(n^3) work into blocked dot products of contiguous rows. Summing over all k and subtracting the k == i and k == j terms gives
+	// sum_{k != i, j} (a[i][k] - a[j][k]) * (bp[j][k] - bp[i][k]) = M[i][j] + M[j][i] - M[i][i] - M[j][j] - (a[i][i] - a[j][i]) * (bp[j][i] - bp[i][i]) - (a[i][j] - a[j][j]) * (bp[j][j] - bp[i][j])
+	// and the same for the column terms with N and the transposed matrices. It's all integer arithmetic, so the deltas are identical to computeDelta.
+	template<bool SelectBestMove, bool Symmetric, typename T>
+	Move initialNeighbourhood(const detail::QAPMatrixView<NumLocations, T>& bp, DeltaArray& delta, PermutedFlow& state) const
+	{
+		const size_t n = NumLocations;
+		const size_t numProducts = Symmetric ? 1 : 2;
+		state.m_products.resize(numProducts * n * n);
+		int64_t* m = state.m_products.data();
+		int64_t* nt = m + (numProducts - 1) * n * n;
+		const T* bpt = nullptr;
+		if (!Symmetric)
+		{
+			state.m_flowTransposed.resize(n * n * sizeof(T) + detail::QAPMatrixPadding);
+			detail::qapTranspose<NumLocations>(bp.data(), reinterpret_cast<T*>(state.m_flowTransposed.data()));
+			bpt = reinterpret_cast<const T*>(state.m_flowTransposed.data());
+		}
+		const T* at = reinterpret_cast<const T*>(m_distancesTransposed.data());
+		auto multiply = [&](size_t firstRow, size_t lastRow)
+		{
+			detail::qapMultiplyTransposed<NumLocations>(distanceMatrix<T>().data(), bp.data(), m, firstRow, lastRow);
+			if (!Symmetric)
+			{
+				detail::qapMultiplyTransposed<NumLocations>(at, bpt, nt, firstRow, lastRow);
+			}
+		};
+		if (NumLocations >= ParallelMinLocations && m_threadPool)
+		{
+			const size_t numThreads = m_threadPool->size();
+			m_threadPool->run([&](size_t t)
+			{
+				multiply(t * n / numThreads, (t + 1) * n / numThreads);
+			});
+		}
+		else
+		{
+			multiply(0, n);
+		}
+
+		auto a = distanceMatrix<T>();
+		Move best = std::make_tuple(Base::NoSwap, Base::NoSwap, std::numeric_limits<FloatingPoint>::lowest());
+		for (size_t i = 0; i < n; i++)
+		{
+			const int64_t aii = a[i][i];
+			const int64_t bpii = bp[i][i];
+			const int64_t mii = m[i * n + i];
+			const int64_t nii = nt[i * n + i];
+			FloatingPoint* row = delta[i].data();
+			for (size_t j = i + 1; j < n; j++)
+			{
+				const int64_t aij = a[i][j];
+				const int64_t aji = a[j][i];
+				const int64_t ajj = a[j][j];
+				const int64_t bpij = bp[i][j];
+				const int64_t bpji = bp[j][i];
+				const int64_t bpjj = bp[j][j];
+				const int64_t rowSum = m[i * n + j] + m[j * n + i] - mii - m[j * n + j] - (aii - aji) * (bpji - bpii) - (aij - ajj) * (bpjj - bpij);
+				int64_t d = (aii - ajj) * (bpjj - bpii);
+				if (Symmetric)
+				{
+					d += 2 * rowSum;
+				}
+				else
+				{
+					const int64_t columnSum = nt[i * n + j] + nt[j * n + i] - nii - nt[j * n + j] - (aii - aij) * (bpij - bpii) - (aji - ajj) * (bpjj - bpji);
+					d += (aij - aji) * (bpji - bpij) + rowSum + columnSum;
+				}
+				row[j] = -static_cast<FloatingPoint>(d);
+			}
+			if (SelectBestMove && i < m_numLocations)
+			{
+				Base::selectBestMove(row, i, i + 1, best, m_numLocations);
+			}
+		}
+		return best;
+	}
+
+	// Updates the delta matrix one row at a time, the best move is selected while the row is still in the cache.
+	// The full neighbourhood is only computed here pair by pair for the callers without a search state
+	template<bool SelectBestMove, bool Symmetric, typename T, typename FlowView>
+	Move updateNeighbourhood(const FlowView& bp, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta) const
+	{
+		const size_t r = lastSwapI;
+		const size_t s = lastSwapJ;
+		Move best = std::make_tuple(Base::NoSwap, Base::NoSwap, std::numeric_limits<FloatingPoint>::lowest());
+		if (r == Base::NoSwap || s == Base::NoSwap)
+		{
+			for (size_t i = 0; i < NumLocations; i++)
+			{
+				for (size_t j = i + 1; j < NumLocations; j++)
+				{
+					delta[i][j] = -static_cast<FloatingPoint>(computeDelta<Symmetric, T>(bp, i, j));
+				}
+				if (SelectBestMove && i < m_numLocations)
+				{
+					Base::selectBestMove(delta[i].data(), i, i + 1, best, m_numLocations);
+				}
+			}
+			return best;
+		}
+
+		// The partial update of Taillard can be separated into per location terms
+		// delta[i][j] += (a1[i] - a1[j]) * (b1[i] - b1[j]) + (a2[i] - a2[j]) * (b2[i] - b2[j])
+		// which turns the inner loop into contiguous vector arithmetic
+		// For symmetric instances a2 == a1 and b2 == b1, so the update is just 2 * (a1[i] - a1[j]) * (b1[i] - b1[j])
+		auto a = distanceMatrix<T>();
+		Vector a1, b1, a2, b2;
+		for (size_t k = 0; k < NumLocations; k++)
+		{
+			a1[k] = a[r][k] - a[s][k];
+			b1[k] = bp[s][k] - bp[r][k];
+		}
+		if (!Symmetric)
+		{
+			for (size_t k = 0; k < NumLocations; k++)
+			{
+				a2[k] = a[k][r] - a[k][s];
+				b2[k] = bp[k][s] - bp[k][r];
+			}
+		}
+
 		for (size_t i = 0; i < NumLocations; i++)
 		{
-			for (size_t j = 0; j < NumLocations; j++)
+			FloatingPoint* row = delta[i].data();
+			if (i == r || i == s)
 			{
-				// TODO it seems like the flow and distances are the wrong way around
-				int a = keyboard.m_keys[i];
-				int b = keyboard.m_keys[j];
-				uint64_t dist = m_distances[i][j];
-				uint64_t flow = m_flow[a][b];
-				sum += dist * flow;
+				for (size_t j = i + 1; j < NumLocations; j++)
+				{
+					row[j] = -static_cast<FloatingPoint>(computeDelta<Symmetric, T>(bp, i, j));
+				}
+			}
+			else
+			{
+				updateRow<Symmetric>(row, i, a1, b1, a2, b2);
+				if (r > i)
+				{
+					row[r] = -static_cast<FloatingPoint>(computeDelta<Symmetric, T>(bp, i, r));
+				}
+				if (s > i)
+				{
+					row[s] = -static_cast<FloatingPoint>(computeDelta<Symmetric, T>(bp, i, s));
+				}
+			}
+			if (SelectBestMove && i < m_numLocations)
+			{
+				Base::selectBestMove(row, i, i + 1, best, m_numLocations);
 			}
 		}
-		return -static_cast<FloatingPoint>(sum);
+		return best;
 	}
-	
-	virtual void evaluateNeighbourhood(const Keyboard<NumLocations>& keyboard, FloatingPoint v, size_t lastSwapI, size_t lastSwapJ, std::array<std::array<FloatingPoint, NumLocations>, NumLocations>& delta) const override
+
+	// Updates the sparse first matrix variant, where a1 and a2 are zero everywhere except at the non zero partners of the swapped locations.
+	// The pairs where both of the locations have zero a1 and a2 terms don't change, so those rows only need to update the changed columns.
+	template<bool SelectBestMove, bool Symmetric, typename T, typename FlowView>
+	Move updateSparseNeighbourhood(const FlowView& bp, size_t lastSwapI, size_t lastSwapJ, DeltaArray& delta) const
 	{
-		bool firstSwap = lastSwapI == std::numeric_limits<size_t>::max() || lastSwapJ == std::numeric_limits<size_t>::max();
+		const size_t r = lastSwapI;
+		const size_t s = lastSwapJ;
+		const bool firstSwap = r == std::numeric_limits<size_t>::max() || s == std::numeric_limits<size_t>::max();
+		Move best = std::make_tuple(Base::NoSwap, Base::NoSwap, std::numeric_limits<FloatingPoint>::lowest());
+		if (firstSwap)
+		{
+			for (size_t i = 0; i < NumLocations; i++)
+			{
+				for (size_t j = i + 1; j < NumLocations; j++)
+				{
+					delta[i][j] = -static_cast<FloatingPoint>(computeSparseDelta<Symmetric, T>(bp, i, j));
+				}
+				if (SelectBestMove && i < m_numLocations)
+				{
+					Base::selectBestMove(delta[i].data(), i, i + 1, best, m_numLocations);
+				}
+			}
+			return best;
+		}
+
+		Vector a1, b1, a2, b2;
+		a1.fill(0);
+		scatterRow(m_sparseRows, r, 1, a1);
+		scatterRow(m_sparseRows, s, -1, a1);
+		for (size_t k = 0; k < NumLocations; k++)
+		{
+			b1[k] = bp[s][k] - bp[r][k];
+		}
+		if (!Symmetric)
+		{
+			a2.fill(0);
+			scatterRow(m_sparseColumns, r, 1, a2);
+			scatterRow(m_sparseColumns, s, -1, a2);
+			for (size_t k = 0; k < NumLocations; k++)
+			{
+				b2[k] = bp[k][s] - bp[k][r];
+			}
+		}
+
+		std::array<uint32_t, NumLocations> changed;
+		size_t numChanged = 0;
+		for (size_t k = 0; k < NumLocations; k++)
+		{
+			if (a1[k] != 0 || (!Symmetric && a2[k] != 0))
+			{
+				changed[numChanged++] = static_cast<uint32_t>(k);
+			}
+		}
+
+		size_t firstChanged = 0;
 		for (size_t i = 0; i < NumLocations; i++)
 		{
-			for (size_t j = i + 1; j < NumLocations; j++)
+			FloatingPoint* row = delta[i].data();
+			while (firstChanged < numChanged && changed[firstChanged] <= i)
 			{
-				if (firstSwap == false && i != lastSwapI && i != lastSwapJ && j != lastSwapI && j != lastSwapJ)
+				firstChanged++;
+			}
+			if (i == r || i == s)
+			{
+				for (size_t j = i + 1; j < NumLocations; j++)
 				{
-					delta[i][j] += -static_cast<FloatingPoint>(computeDeltaPart(keyboard, delta, i, j, lastSwapI, lastSwapJ));
+					row[j] = -static_cast<FloatingPoint>(computeSparseDelta<Symmetric, T>(bp, i, j));
+				}
+			}
+			else
+			{
+				if (a1[i] != 0 || (!Symmetric && a2[i] != 0))
+				{
+					updateRow<Symmetric>(row, i, a1, b1, a2, b2);
 				}
 				else
 				{
-					delta[i][j] = -static_cast<FloatingPoint>(computeDelta(keyboard, i, j));
+					const int64_t b1i = b1[i];
+					const int64_t b2i = Symmetric ? 0 : b2[i];
+					for (size_t c = firstChanged; c < numChanged; c++)
+					{
+						const size_t j = changed[c];
+						if (Symmetric)
+						{
+							row[j] += -static_cast<FloatingPoint>(-2 * a1[j] * (b1i - b1[j]));
+						}
+						else
+						{
+							row[j] += -static_cast<FloatingPoint>(-a1[j] * (b1i - b1[j]) - a2[j] * (b2i - b2[j]));
+						}
+					}
 				}
+				if (r > i)
+				{
+					row[r] = -static_cast<FloatingPoint>(computeSparseDelta<Symmetric, T>(bp, i, r));
+				}
+				if (s > i)
+				{
+					row[s] = -static_cast<FloatingPoint>(computeSparseDelta<Symmetric, T>(bp, i, s));
+				}
+			}
+			if (SelectBestMove && i < m_numLocations)
+			{
+				Base::selectBestMove(row, i, i + 1, best, m_numLocations);
 			}
 		}
+		return best;
 	}
 
-private:
-	int64_t computeDelta(const Keyboard<NumLocations>& keyboard, size_t i, size_t j) const
+	template<bool Symmetric>
+	static void updateRow(FloatingPoint* row, size_t i, const Vector& a1, const Vector& b1, const Vector& a2, const Vector& b2)
 	{
-		auto& a = m_distances;
-		auto& b = m_flow;
-		auto& p = keyboard.m_keys;
-		auto d = (a[i][i] - a[j][j])*(b[p[j]][p[j]] - b[p[i]][p[i]]) +
-			(a[i][j] - a[j][i])*(b[p[j]][p[i]] - b[p[i]][p[j]]);
+		const int64_t a1i = a1[i];
+		const int64_t b1i = b1[i];
+		if (Symmetric)
+		{
+			for (size_t j = i + 1; j < NumLocations; j++)
+			{
+				row[j] += -static_cast<FloatingPoint>(2 * (a1i - a1[j]) * (b1i - b1[j]));
+			}
+		}
+		else
+		{
+			const int64_t a2i = a2[i];
+			const int64_t b2i = b2[i];
+			for (size_t j = i + 1; j < NumLocations; j++)
+			{
+				row[j] += -static_cast<FloatingPoint>((a1i - a1[j]) * (b1i - b1[j]) + (a2i - a2[j]) * (b2i - b2[j]));
+			}
+		}
+	}
+
+	static void scatterRow(const detail::QAPSparseMatrix& m, size_t row, int64_t sign, Vector& v)
+	{
+		for (uint32_t e = m.m_start[row]; e < m.m_start[row + 1]; e++)
+		{
+			v[m.m_index[e]] += sign * m.m_value[e];
+		}
+	}
+
+	static bool isSymmetric(const std::vector<int64_t>& m)
+	{
+		for (size_t i = 0; i < NumLocations; i++)
+		{
+			for (size_t j = i + 1; j < NumLocations; j++)
+			{
+				if (m[i * NumLocations + j] != m[j * NumLocations + i])
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
 
+	template<bool Symmetric, typename T, typename FlowView>
+	int64_t computeDelta(const FlowView& bp, size_t i, size_t j) const
+	{
+		auto a = distanceMatrix<T>();
+		auto d = (a[i][i] - a[j][j])*(bp[j][j] - bp[i][i]);
+		if (Symmetric)
+		{
+			// The column terms equal the row terms, and the a[i][j] term cancels out. The row terms are the dot products
+			// of the whole rows, which are vectorized, minus the k == i and k == j terms
+			const T* ai = a[i].data();
+			const T* aj = a[j].data();
+			const auto bpi = bp[i];
+			const auto bpj = bp[j];
+			int64_t sum = rowDot(ai, bpj) - rowDot(ai, bpi) - rowDot(aj, bpj) + rowDot(aj, bpi);
+			sum -= (a[i][i] - a[j][i])*(bp[j][i] - bp[i][i]) + (a[i][j] - a[j][j])*(bp[j][j] - bp[i][j]);
+			return d + 2 * sum;
+		}
+
+		d += (a[i][j] - a[j][i])*(bp[j][i] - bp[i][j]);
 		for (size_t k = 0; k < NumLocations; k++)
 		{
 			if (k != i && k != j)
 			{
-				d = d + (a[k][i] - a[k][j])*(b[p[k]][p[j]] - b[p[k]][p[i]]) +
-					(a[i][k] - a[j][k])*(b[p[j]][p[k]] - b[p[i]][p[k]]);
+				d = d + (a[k][i] - a[k][j])*(bp[k][j] - bp[k][i]) +
+					(a[i][k] - a[j][k])*(bp[j][k] - bp[i][k]);
 			}
 		}
 
 		return d;
 	}
 
-	int64_t computeDeltaPart(const Keyboard<NumLocations>& keyboard, const std::array<std::array<FloatingPoint, NumLocations>, NumLocations>& delta,
-		size_t i, size_t j, size_t r, size_t s) const
+	template<bool Symmetric, typename T, typename FlowView>
+	int64_t computeSparseDelta(const FlowView& bp, size_t i, size_t j) const
 	{
-		auto& a = m_distances;
-		auto& b = m_flow;
-		auto& p = keyboard.m_keys;
-
-		return((a[r][i] - a[r][j] + a[s][j] - a[s][i])*
-			(b[p[s]][p[i]] - b[p[s]][p[j]] + b[p[r]][p[j]] - b[p[r]][p[i]]) +
-			(a[i][r] - a[j][r] + a[j][s] - a[i][s])*
-			(b[p[i]][p[s]] - b[p[j]][p[s]] + b[p[j]][p[r]] - b[p[i]][p[r]]));
+		auto a = distanceMatrix<T>();
+		auto d = (a[i][i] - a[j][j])*(bp[j][j] - bp[i][i]);
+		auto bpi = bp[i];
+		auto bpj = bp[j];
+		auto rowTerm = [&](size_t k) { return bpj[k] - bpi[k]; };
+		const int64_t rowSum = m_sparseRows.sumRowExcept(i, i, j, rowTerm) - m_sparseRows.sumRowExcept(j, i, j, rowTerm);
+		if (Symmetric)
+		{
+			return d + 2 * rowSum;
+		}
 
+		auto columnTerm = [&](size_t k) { return bp[k][j] - bp[k][i]; };
+		d += (a[i][j] - a[j][i])*(bp[j][i] - bp[i][j]);
+		return d + rowSum + m_sparseColumns.sumRowExcept(i, i, j, columnTerm) - m_sparseColumns.sumRowExcept(j, i, j, columnTerm);
 	}
 
-	std::array<std::array<int64_t, NumLocations>, NumLocations> m_distances;
-	std::array<std::array<int64_t, NumLocations>, NumLocations> m_flow;
-};
\ No newline at end of file
+	// Raw storage of the matrices, the element type is given by m_valueType. It's owned by m_storage, which can be a mapped cache file.
+	const uint8_t* m_distances = nullptr;
+	const uint8_t* m_flow = nullptr;
+	std::shared_ptr<const void> m_storage;
+	detail::QAPValueType m_valueType = detail::QAPValueType::Int64;
+	size_t m_numLocations = NumLocations;
+	bool m_symmetric = false;
+	bool m_sparse = false;
+	// The non zeros of the first matrix by row and by column, only built for the sparse storage
+	detail::QAPSparseMatrix m_sparseRows;
+	detail::QAPSparseMatrix m_sparseColumns;
+	// The transpose of the first matrix, only built for the dense storage of asymmetric instances
+	std::vector<uint8_t> m_distancesTransposed;
+	std::shared_ptr<detail::ThreadPool> m_threadPool;
+};
@@ -0,0 +1,444 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// Low level evaluation kernels for the QAP objective. The matrices are stored row major with a row stride of NumLocations.
+// The element type of the matrices is the narrowest type that can hold all the values, everything is widened to 64 bits before any arithmetic.
+namespace detail
+{
+	enum class QAPValueType
+	{
+		Int8,
+		Int16,
+		Int32,
+		Int64,
+	};
+
+	template<typename T>
+	bool qapValueFits(int64_t minValue, int64_t maxValue)
+	{
+		return minValue >= std::numeric_limits<T>::min() && maxValue <= std::numeric_limits<T>::max();
+	}
+
+	inline QAPValueType qapSelectValueType(int64_t minValue, int64_t maxValue)
+	{
+		if (qapValueFits<int8_t>(minValue, maxValue))
+		{
+			return QAPValueType::Int8;
+		}
+		else if (qapValueFits<int16_t>(minValue, maxValue))
+		{
+			return QAPValueType::Int16;
+		}
+		else if (qapValueFits<int32_t>(minValue, maxValue))
+		{
+			return QAPValueType::Int32;
+		}
+		return QAPValueType::Int64;
+	}
+
+	// Read only view of a square matrix stored with narrow values, the elements are widened to 64 bits on access
+	template<size_t NumLocations, typename T>
+	class QAPMatrixView
+	{
+	public:
+		class Row
+		{
+		public:
+			explicit Row(const T* row)
+				: m_row(row)
+			{
+			}
+
+			int64_t operator[](size_t j) const
+			{
+				return m_row[j];
+			}
+
+			const T* data() const
+			{
+				return m_row;
+			}
+
+		private:
+			const T* m_row;
+		};
+
+		explicit QAPMatrixView(const T* data)
+			: m_data(data)
+		{
+		}
+
+		Row operator[](size_t i) const
+		{
+			return Row(m_data + i * NumLocations);
+		}
+
+		const T* data() const
+		{
+			return m_data;
+		}
+
+	private:
+		const T* m_data;
+	};
+
+	// Compressed sparse row storage of the non zero elements of a square matrix
+	struct QAPSparseMatrix
+	{
+		template<size_t NumLocations>
+		static QAPSparseMatrix fromDense(const std::vector<int64_t>& m, bool transpose)
+		{
+			QAPSparseMatrix ret;
+			ret.m_start.reserve(NumLocations + 1);
+			ret.m_start.push_back(0);
+			for (size_t i = 0; i < NumLocations; i++)
+			{
+				for (size_t k = 0; k < NumLocations; k++)
+				{
+					int64_t v = transpose ? m[k * NumLocations + i] : m[i * NumLocations + k];
+					if (v != 0)
+					{
+						ret.m_index.push_back(static_cast<uint32_t>(k));
+						ret.m_value.push_back(v);
+					}
+				}
+				ret.m_start.push_back(static_cast<uint32_t>(ret.m_index.size()));
+			}
+			return ret;
+		}
+
+		// Sum of m[row][k] * x(k) over the non zero elements, excluding the columns i and j
+		template<typename Fn>
+		int64_t sumRowExcept(size_t row, size_t i, size_t j, Fn x) const
+		{
+			int64_t sum = 0;
+			for (uint32_t e = m_start[row]; e < m_start[row + 1]; e++)
+			{
+				const size_t k = m_index[e];
+				if (k != i && k != j)
+				{
+					sum += m_value[e] * x(k);
+				}
+			}
+			return sum;
+		}
+
+		std::vector<uint32_t> m_start;
+		std::vector<uint32_t> m_index;
+		std::vector<int64_t> m_value;
+	};
+
+	// The vectorized kernel gathers 32 bits per element, so the matrix storage needs this many bytes of padding after the last element
+	const size_t QAPMatrixPadding = sizeof(int32_t);
+
+	template<size_t NumLocations>
+	struct QAPScalarKernel
+	{
+		template<typename T, typename KeyType>
+		static int64_t evaluateRow(const T* distances, const T* flow, const KeyType* keys)
+		{
+			int64_t sum = 0;
+			for (size_t j = 0; j < NumLocations; j++)
+			{
+				sum += static_cast<int64_t>(distances[j]) * flow[keys[j]];
+			}
+			return sum;
+		}
+
+		template<typename T>
+		static int64_t dot(const T* x, const T* y)
+		{
+			int64_t sum = 0;
+			for (size_t k = 0; k < NumLocations; k++)
+			{
+				sum += static_cast<int64_t>(x[k]) * y[k];
+			}
+			return sum;
+		}
+	};
+
+#if defined(__AVX512F__)
+	const size_t QAPSimdWidth = 8;
+#elif defined(__AVX2__)
+	const size_t QAPSimdWidth = 4;
+#else
+	const size_t QAPSimdWidth = 0;
+#endif
+
+	// The vectorized kernel multiplies the sign extended 32 bit values of each lane, so it can only be used when the values are stored in 32 bits or less.
+	// The sums are accumulated in 64 bit lanes and integer addition is associative, so the result is identical to the scalar kernel.
+	template<size_t NumLocations, typename T, bool UseSimd = (QAPSimdWidth != 0 && NumLocations >= QAPSimdWidth && sizeof(T) <= sizeof(int32_t))>
+	struct QAPEvaluateKernel : public QAPScalarKernel<NumLocations>
+	{
+	};
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+	template<typename KeyType>
+	struct QAPGatherIndices
+	{
+	};
+
+	template<>
+	struct QAPGatherIndices<unsigned char>
+	{
+		static __m128i load4(const unsigned char* keys)
+		{
+			int32_t v;
+			memcpy(&v, keys, sizeof(v));
+			return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+		}
+
+		static __m256i load8(const unsigned char* keys)
+		{
+			return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(keys)));
+		}
+	};
+
+	template<>
+	struct QAPGatherIndices<unsigned int>
+	{
+		static __m128i load4(const unsigned int* keys)
+		{
+			return _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+		}
+
+		static __m256i load8(const unsigned int* keys)
+		{
+			return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+		}
+	};
+
+	// Loads consecutive values sign extended to 64 bit lanes
+	template<typename T>
+	struct QAPWidenValues
+	{
+	};
+
+	template<>
+	struct QAPWidenValues<int8_t>
+	{
+		static __m256i load4(const int8_t* values)
+		{
+			int32_t v;
+			memcpy(&v, values, sizeof(v));
+			return _mm256_cvtepi8_epi64(_mm_cvtsi32_si128(v));
+		}
+
+#if defined(__AVX512F__)
+		static __m512i load8(const int8_t* values)
+		{
+			return _mm512_cvtepi8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(values)));
+		}
+#endif
+	};
+
+	template<>
+	struct QAPWidenValues<int16_t>
+	{
+		static __m256i load4(const int16_t* values)
+		{
+			return _mm256_cvtepi16_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(values)));
+		}
+
+#if defined(__AVX512F__)
+		static __m512i load8(const int16_t* values)
+		{
+			return _mm512_cvtepi16_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)));
+		}
+#endif
+	};
+
+	template<>
+	struct QAPWidenValues<int32_t>
+	{
+		static __m256i load4(const int32_t* values)
+		{
+			return _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values)));
+		}
+
+#if defined(__AVX512F__)
+		static __m512i load8(const int32_t* values)
+		{
+			return _mm512_cvtepi32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values)));
+		}
+#endif
+	};
+
+	// Gathers 32 bits at each index and sign extends the low sizeof(T) bytes, this reads up to QAPMatrixPadding bytes past the last element
+	template<typename T>
+	struct QAPGatherValues
+	{
+		static const int Shift = static_cast<int>(32 - 8 * sizeof(T));
+
+		static __m256i gather4(const T* values, __m128i indices)
+		{
+			__m128i v = _mm_i32gather_epi32(reinterpret_cast<const int*>(values), indices, sizeof(T));
+			if (Shift != 0)
+			{
+				v = _mm_srai_epi32(_mm_slli_epi32(v, Shift), Shift);
+			}
+			return _mm256_cvtepi32_epi64(v);
+		}
+
+#if defined(__AVX512F__)
+		static __m512i gather8(const T* values, __m256i indices)
+		{
+			__m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(values), indices, sizeof(T));
+			if (Shift != 0)
+			{
+				v = _mm256_srai_epi32(_mm256_slli_epi32(v, Shift), Shift);
+			}
+			return _mm512_cvtepi32_epi64(v);
+		}
+#endif
+	};
+
+	template<size_t NumLocations, typename T>
+	struct QAPEvaluateKernel<NumLocations, T, true>
+	{
+		template<typename KeyType>
+		static int64_t evaluateRow(const T* distances, const T* flow, const KeyType* keys)
+		{
+			size_t j = 0;
+#if defined(__AVX512F__)
+			__m512i acc = _mm512_setzero_si512();
+			for (; j + 8 <= NumLocations; j += 8)
+			{
+				__m512i f = QAPGatherValues<T>::gather8(flow, QAPGatherIndices<KeyType>::load8(keys + j));
+				__m512i d = QAPWidenValues<T>::load8(distances + j);
+				acc = _mm512_add_epi64(acc, _mm512_mul_epi32(d, f));
+			}
+			int64_t sum = _mm512_reduce_add_epi64(acc);
+#else
+			__m256i acc = _mm256_setzero_si256();
+			for (; j + 4 <= NumLocations; j += 4)
+			{
+				__m256i f = QAPGatherValues<T>::gather4(flow, QAPGatherIndices<KeyType>::load4(keys + j));
+				__m256i d = QAPWidenValues<T>::load4(distances + j);
+				acc = _mm256_add_epi64(acc, _mm256_mul_epi32(d, f));
+			}
+			__m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+			int64_t sum = _mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1);
+#endif
+			for (; j < NumLocations; j++)
+			{
+				sum += static_cast<int64_t>(distances[j]) * flow[keys[j]];
+			}
+			return sum;
+		}
+
+		static int64_t dot(const T* x, const T* y)
+		{
+			size_t k = 0;
+#if defined(__AVX512F__)
+			__m512i acc = _mm512_setzero_si512();
+			for (; k + 8 <= NumLocations; k += 8)
+			{
+				acc = _mm512_add_epi64(acc, _mm512_mul_epi32(QAPWidenValues<T>::load8(x + k), QAPWidenValues<T>::load8(y + k)));
+			}
+			int64_t sum = _mm512_reduce_add_epi64(acc);
+#else
+			__m256i acc = _mm256_setzero_si256();
+			for (; k + 4 <= NumLocations; k += 4)
+			{
+				acc = _mm256_add_epi64(acc, _mm256_mul_epi32(QAPWidenValues<T>::load4(x + k), QAPWidenValues<T>::load4(y + k)));
+			}
+			__m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+			int64_t sum = _mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1);
+#endif
+			for (; k < NumLocations; k++)
+			{
+				sum += static_cast<int64_t>(x[k]) * y[k];
+			}
+			return sum;
+		}
+	};
+#endif
+
+	// Read only view of a square matrix through a permutation, m[i][j] is read as data[p[i]][p[j]] without building the permuted matrix
+	template<size_t NumLocations, typename T, typename KeyType>
+	class QAPPermutedMatrixView
+	{
+	public:
+		class Row
+		{
+		public:
+			Row(const T* row, const KeyType* keys)
+				: m_row(row)
+				, m_keys(keys)
+			{
+			}
+
+			int64_t operator[](size_t j) const
+			{
+				return m_row[m_keys[j]];
+			}
+
+			// The dot product of x with the permuted row, which gathers the row like the evaluation kernel
+			int64_t dot(const T* x) const
+			{
+				return QAPEvaluateKernel<NumLocations, T>::evaluateRow(x, m_row, m_keys);
+			}
+
+		private:
+			const T* m_row;
+			const KeyType* m_keys;
+		};
+
+		QAPPermutedMatrixView(const T* data, const KeyType* keys)
+			: m_data(data)
+			, m_keys(keys)
+		{
+		}
+
+		Row operator[](size_t i) const
+		{
+			return Row(m_data + static_cast<size_t>(m_keys[i]) * NumLocations, m_keys);
+		}
+
+	private:
+		const T* m_data;
+		const KeyType* m_keys;
+	};
+
+	// The product x * y^T of two square matrices, out[i][j] is the dot product of the rows x[i] and y[j] for the rows i in [firstRow, lastRow).
+	// The rows of y are processed in blocks that stay in the L1 cache while the rows of x are multiplied with them.
+	template<size_t NumLocations, typename T>
+	void qapMultiplyTransposed(const T* x, const T* y, int64_t* out, size_t firstRow, size_t lastRow)
+	{
+		const size_t blockSize = NumLocations * sizeof(T) >= 16 * 1024 ? 1 : 16 * 1024 / (NumLocations * sizeof(T));
+		for (size_t blockStart = 0; blockStart < NumLocations; blockStart += blockSize)
+		{
+			const size_t blockEnd = std::min(blockStart + blockSize, NumLocations);
+			for (size_t i = firstRow; i < lastRow; i++)
+			{
+				const T* row = x + i * NumLocations;
+				int64_t* outRow = out + i * NumLocations;
+				for (size_t j = blockStart; j < blockEnd; j++)
+				{
+					outRow[j] = QAPEvaluateKernel<NumLocations, T>::dot(row, y + j * NumLocations);
+				}
+			}
+		}
+	}
+
+	template<size_t NumLocations, typename T>
+	void qapTranspose(const T* m, T* out)
+	{
+		for (size_t i = 0; i < NumLocations; i++)
+		{
+			for (size_t j = 0; j < NumLocations; j++)
+			{
+				out[j * NumLocations + i] = m[i * NumLocations + j];
+			}
+		}
+	}
+}
@@ -0,0 +1,292 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <utility>
+
+// The random number engines of the optimizers. Both are uniform random bit generators, so they also work with the
+// standard distributions, and both can be copied as they are in memory, which the checkpoints rely on.
+
+// xoshiro256** of Blackman and Vigna, the default engine. The stream constructor jumps the state 2^128 steps per
+// stream, so the streams never overlap, but a stream costs a few hundred steps to create per stream index
+class Xoshiro256StarStar
+{
+public:
+	typedef uint64_t result_type;
+
+	explicit Xoshiro256StarStar(uint64_t seed = 0, uint64_t stream = 0)
+	{
+		this->seed(seed, stream);
+	}
+
+	void seed(uint64_t seed, uint64_t stream = 0)
+	{
+		// The state is filled with splitmix64, which never gives an all zero state
+		for (auto&& s : m_state)
+		{
+			seed += 0x9e3779b97f4a7c15ull;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			s = z ^ (z >> 31);
+		}
+		for (uint64_t i = 0; i < stream; i++)
+		{
+			jump();
+		}
+	}
+
+	// The raw state, for the reference values of the tests
+	void state(const std::array<uint64_t, 4>& state)
+	{
+		m_state = state;
+	}
+
+	result_type operator()()
+	{
+		const uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+		const uint64_t t = m_state[1] << 17;
+		m_state[2] ^= m_state[0];
+		m_state[3] ^= m_state[1];
+		m_state[1] ^= m_state[2];
+		m_state[0] ^= m_state[3];
+		m_state[2] ^= t;
+		m_state[3] = rotl(m_state[3], 45);
+		return result;
+	}
+
+	// Advances the state by 2^128 steps
+	void jump()
+	{
+		static const uint64_t polynomial[] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+		std::array<uint64_t, 4> state = {};
+		for (auto&& word : polynomial)
+		{
+			for (int b = 0; b < 64; b++)
+			{
+				if (word & (uint64_t(1) << b))
+				{
+					for (size_t i = 0; i < state.size(); i++)
+					{
+						state[i] ^= m_state[i];
+					}
+				}
+				(*this)();
+			}
+		}
+		m_state = state;
+	}
+
+	static constexpr result_type min()
+	{
+		return 0;
+	}
+
+	static constexpr result_type max()
+	{
+		return std::numeric_limits<result_type>::max();
+	}
+
+	bool operator==(const Xoshiro256StarStar& rhs) const
+	{
+		return m_state == rhs.m_state;
+	}
+
+	bool operator!=(const Xoshiro256StarStar& rhs) const
+	{
+		return !(*this == rhs);
+	}
+
+private:
+	static uint64_t rotl(uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+
+	std::array<uint64_t, 4> m_state;
+};
+
+// Philox4x32-10 of Salmon et al., a counter based engine. The numbers are the encryptions of a counter with the seed
+// as the key, and the upper half of the counter is the stream, so any number of independent streams are free to create
+class Philox4x32
+{
+public:
+	typedef uint64_t result_type;
+	typedef std::array<uint32_t, 4> Block;
+	typedef std::array<uint32_t, 2> Key;
+
+	explicit Philox4x32(uint64_t seed = 0, uint64_t stream = 0)
+	{
+		this->seed(seed, stream);
+	}
+
+	void seed(uint64_t seed, uint64_t stream = 0)
+	{
+		m_key = { static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32) };
+		m_counter = { 0, 0, static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32) };
+		m_used = 2;
+	}
+
+	// The ten rounds of the cipher
+	static Block block(Block counter, Key key)
+	{
+		for (int round = 0; round < 10; round++)
+		{
+			const uint64_t product0 = uint64_t(0xd2511f53) * counter[0];
+			const uint64_t product1 = uint64_t(0xcd9e8d57) * counter[2];
+			counter = {
+				static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key[0],
+				static_cast<uint32_t>(product1),
+				static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key[1],
+				static_cast<uint32_t>(product0) };
+			key[0] += 0x9e3779b9;
+			key[1] += 0xbb67ae85;
+		}
+		return counter;
+	}
+
+	result_type operator()()
+	{
+		if (m_used == 2)
+		{
+			m_output = block(m_counter, m_key);
+			if (++m_counter[0] == 0)
+			{
+				m_counter[1]++;
+			}
+			m_used = 0;
+		}
+		const size_t i = 2 * m_used++;
+		return (uint64_t(m_output[i + 1]) << 32) | m_output[i];
+	}
+
+	static constexpr result_type min()
+	{
+		return 0;
+	}
+
+	static constexpr result_type max()
+	{
+		return std::numeric_limits<result_type>::max();
+	}
+
+	bool operator==(const Philox4x32& rhs) const
+	{
+		return m_key == rhs.m_key && m_counter == rhs.m_counter && m_used == rhs.m_used && (m_used == 2 || m_output == rhs.m_output);
+	}
+
+	bool operator!=(const Philox4x32& rhs) const
+	{
+		return !(*this == rhs);
+	}
+
+private:
+	Key m_key;
+	Block m_counter;
+	Block m_output;
+	uint32_t m_used;
+};
+
+namespace detail
+{
+	// The engine of a stream. The engines of the library take the stream directly, and the standard ones are seeded
+	// from a seed sequence, which makes overlaps unlikely rather than impossible
+	template<typename RandomGenerator>
+	struct RandomStream
+	{
+		static RandomGenerator create(uint64_t seed, uint64_t stream)
+		{
+			std::seed_seq sequence{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32) };
+			return RandomGenerator(sequence);
+		}
+	};
+
+	template<>
+	struct RandomStream<Xoshiro256StarStar>
+	{
+		static Xoshiro256StarStar create(uint64_t seed, uint64_t stream)
+		{
+			return Xoshiro256StarStar(seed, stream);
+		}
+	};
+
+	template<>
+	struct RandomStream<Philox4x32>
+	{
+		static Philox4x32 create(uint64_t seed, uint64_t stream)
+		{
+			return Philox4x32(seed, stream);
+		}
+	};
+
+	template<typename RandomGenerator>
+	RandomGenerator randomStream(uint64_t seed, uint64_t stream)
+	{
+		return RandomStream<RandomGenerator>::create(seed, stream);
+	}
+
+	// The helpers below replace the standard distributions in the inner loops, where constructing a distribution and
+	// its rejection loop showed up in the profiles. They need an engine with a full range of 32 or 64 bits
+
+	// 32 random bits, the upper ones of a 64 bit engine
+	template<typename RandomGenerator>
+	uint32_t randomBits(RandomGenerator& generator)
+	{
+		static_assert(RandomGenerator::min() == 0 &&
+			(RandomGenerator::max() == std::numeric_limits<uint32_t>::max() || RandomGenerator::max() == std::numeric_limits<uint64_t>::max()),
+			"The engine needs a full range of 32 or 64 bits");
+		const uint64_t bits = generator();
+		return static_cast<uint32_t>(RandomGenerator::max() > std::numeric_limits<uint32_t>::max() ? bits >> 32 : bits);
+	}
+
+	// A uniform integer in [0, n) with Lemire's multiply and reject, which rarely needs a division. n <= 2^32
+	template<typename RandomGenerator>
+	size_t randomIndex(RandomGenerator& generator, size_t n)
+	{
+		const uint32_t range = static_cast<uint32_t>(n);
+		uint64_t product = uint64_t(randomBits(generator)) * range;
+		if (static_cast<uint32_t>(product) < range)
+		{
+			const uint32_t threshold = static_cast<uint32_t>(-range) % range;
+			while (static_cast<uint32_t>(product) < threshold)
+			{
+				product = uint64_t(randomBits(generator)) * range;
+			}
+		}
+		return static_cast<size_t>(product >> 32);
+	}
+
+	// A uniform float in [0, 1)
+	template<typename RandomGenerator>
+	float randomFloat(RandomGenerator& generator)
+	{
+		return (randomBits(generator) >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// A uniform float in [a, b)
+	template<typename RandomGenerator>
+	float randomFloat(RandomGenerator& generator, float a, float b)
+	{
+		return a + (b - a) * randomFloat(generator);
+	}
+
+	template<typename RandomGenerator>
+	bool randomBool(RandomGenerator& generator)
+	{
+		return (randomBits(generator) >> 31) != 0;
+	}
+
+	// Fisher-Yates with randomIndex
+	template<typename Itr, typename RandomGenerator>
+	void shuffle(Itr begin, Itr end, RandomGenerator& generator)
+	{
+		const size_t n = static_cast<size_t>(std::distance(begin, end));
+		for (size_t i = n; i > 1; i--)
+		{
+			using std::swap;
+			swap(begin[i - 1], begin[randomIndex(generator, i)]);
+		}
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "Keyboard.hpp"
+#include "BinaryFile.hpp"
+
+// A change of the best solution of a run, with the number of evaluations and the time in seconds it took to find it
+template<size_t KeyboardSize, typename Cost>
+struct Snapshot
+{
+	Cost m_solution;
+	Keyboard<KeyboardSize> m_keyboard;
+	uint64_t m_evaluations;
+	double m_time;
+};
+
+// Snapshot sinks for the anytime runs. The optimizers copy their sinks, so these are passed by std::ref
+
+// Keeps the latest capacity snapshots
+template<size_t KeyboardSize, typename Cost>
+class SnapshotRingBuffer
+{
+public:
+	explicit SnapshotRingBuffer(size_t capacity) :
+		m_capacity(std::max<size_t>(capacity, 1))
+	{
+		m_snapshots.reserve(m_capacity);
+	}
+
+	void operator()(const Snapshot<KeyboardSize, Cost>& snapshot)
+	{
+		if (m_snapshots.size() < m_capacity)
+		{
+			m_snapshots.push_back(snapshot);
+		}
+		else
+		{
+			m_snapshots[m_next] = snapshot;
+		}
+		m_next = (m_next + 1) % m_capacity;
+	}
+
+	// Oldest first
+	std::vector<Snapshot<KeyboardSize, Cost>> snapshots() const
+	{
+		std::vector<Snapshot<KeyboardSize, Cost>> ret(m_snapshots);
+		if (m_snapshots.size() == m_capacity)
+		{
+			std::rotate(ret.begin(), ret.begin() + m_next, ret.end());
+		}
+		return ret;
+	}
+
+private:
+	size_t m_capacity;
+	size_t m_next = 0;
+	std::vector<Snapshot<KeyboardSize, Cost>> m_snapshots;
+};
+
+// Appends the snapshots to a binary file and flushes them, so that they survive the process. A run that continues
+// from a checkpoint extends the same file
+template<size_t KeyboardSize, typename Cost>
+class SnapshotFile
+{
+public:
+	explicit SnapshotFile(const std::string& filename) :
+		m_file(fopen(filename.c_str(), "ab"))
+	{
+		if (!m_file)
+		{
+			throw std::invalid_argument("Can't open the snapshot file " + filename);
+		}
+	}
+
+	SnapshotFile(const SnapshotFile&) = delete;
+	SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+	~SnapshotFile()
+	{
+		fclose(m_file);
+	}
+
+	void operator()(const Snapshot<KeyboardSize, Cost>& snapshot)
+	{
+		detail::writeValue(m_file, snapshot);
+		fflush(m_file);
+	}
+
+	static std::vector<Snapshot<KeyboardSize, Cost>> read(const std::string& filename)
+	{
+		std::vector<Snapshot<KeyboardSize, Cost>> ret;
+		FILE* file = fopen(filename.c_str(), "rb");
+		if (file)
+		{
+			Snapshot<KeyboardSize, Cost> snapshot;
+			while (detail::readValue(file, snapshot))
+			{
+				ret.push_back(snapshot);
+			}
+			fclose(file);
+		}
+		return ret;
+	}
+
+private:
+	FILE* m_file;
+};
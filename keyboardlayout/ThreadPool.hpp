@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace detail
+{
+	// A fixed set of threads that are started once and wait behind a barrier between the calls to run, so that the tasks
+	// of every generation don't pay for creating and joining threads. The calling thread takes part as the first thread.
+	class ThreadPool
+	{
+	public:
+		explicit ThreadPool(size_t numThreads)
+		{
+			for (size_t t = 1; t < numThreads; t++)
+			{
+				m_threads.emplace_back([this, t]() { work(t); });
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_exit = true;
+			}
+			m_start.notify_all();
+			for (auto&& thread : m_threads)
+			{
+				thread.join();
+			}
+		}
+
+		size_t size() const
+		{
+			return m_threads.size() + 1;
+		}
+
+		// Calls task(t) for every t in [0, size()) and returns when all the calls are done. When the pool is already
+		// running, for example when a task calls run again, the calls are made one after the other on the calling thread
+		template<typename Task>
+		void run(Task&& task)
+		{
+			if (m_threads.empty() || m_busy.exchange(true))
+			{
+				for (size_t t = 0; t < size(); t++)
+				{
+					task(t);
+				}
+				return;
+			}
+			typedef typename std::remove_reference<Task>::type TaskType;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_task = const_cast<void*>(static_cast<const void*>(&task));
+				m_invoke = [](void* task, size_t t) { (*static_cast<TaskType*>(task))(t); };
+				m_numRunning = m_threads.size();
+				m_generation++;
+			}
+			m_start.notify_all();
+			task(0);
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_done.wait(lock, [this]() { return m_numRunning == 0; });
+			}
+			m_busy = false;
+		}
+
+	private:
+		void work(size_t t)
+		{
+			uint64_t generation = 0;
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_start.wait(lock, [this, generation]() { return m_exit || m_generation != generation; });
+					if (m_exit)
+					{
+						return;
+					}
+					generation = m_generation;
+				}
+				m_invoke(m_task, t);
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					if (--m_numRunning == 0)
+					{
+						m_done.notify_one();
+					}
+				}
+			}
+		}
+
+		std::vector<std::thread> m_threads;
+		std::mutex m_mutex;
+		std::condition_variable m_start;
+		std::condition_variable m_done;
+		// The task of the current call, invoked through a plain function pointer so that it doesn't need to be copied
+		void* m_task = nullptr;
+		void (*m_invoke)(void*, size_t) = nullptr;
+		uint64_t m_generation = 0;
+		size_t m_numRunning = 0;
+		bool m_exit = false;
+		std::atomic<bool> m_busy{ false };
+	};
+}
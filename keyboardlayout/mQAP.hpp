@@ -2,43 +2,57 @@
 #include "Objective.hpp"
 #include "Keyboard.hpp"
 #include <string>
-#include <fstream>
+#include <stdexcept>
+#include "InstanceLoader.hpp"
 
 template<size_t NumLocations>
 class mQAP : public Objective<NumLocations>
 {
 public:
 	mQAP(const std::string& filename, size_t objective)
+		: mQAP(detail::loadmQAPInstance(filename), objective)
 	{
-		std::ifstream stream(filename);
-		std::getline(stream, std::string());
-		for (size_t i = 0; i < NumLocations; i++)
+	}
+
+	// Several objectives can be created from the same parsed instance
+	mQAP(const detail::mQAPInstance& instance, size_t objective)
+	{
+		const size_t numLocations = instance.m_numLocations;
+		if (numLocations > NumLocations)
 		{
-			for (size_t j = 0; j < NumLocations; j++)
-			{
-				stream >> m_distances[i][j];
-			}
-			std::getline(stream, std::string());
+			throw std::invalid_argument("The mQAP instance has more locations than the objective");
 		}
-		std::getline(stream, std::string());
-		for (size_t k = 0; k < objective; k++)
+		if (objective >= instance.m_numObjectives)
 		{
-			for (size_t i = 0; i < NumLocations; i++)
-			{
-				std::getline(stream, std::string());
-			}
-			std::getline(stream, std::string());
+			throw std::invalid_argument("The mQAP instance doesn't have the objective");
 		}
-		for (size_t i = 0; i < NumLocations; i++)
+		// Smaller instances are padded with dummy locations that have no distances or flows, which the optimizers
+		// leave out of the search
+		m_numLocations = numLocations;
+		for (auto&& row : m_distances)
 		{
-			for (size_t j = 0; j < NumLocations; j++)
+			row.fill(0);
+		}
+		for (auto&& row : m_flow)
+		{
+			row.fill(0);
+		}
+		auto& flow = instance.m_flows[objective];
+		for (size_t i = 0; i < numLocations; i++)
+		{
+			for (size_t j = 0; j < numLocations; j++)
 			{
-				stream >> m_flow[i][j];
+				m_distances[i][j] = instance.m_distances[i * numLocations + j];
+				m_flow[i][j] = flow[i * numLocations + j];
 			}
-			std::getline(stream, std::string());
 		}
 	}
 
+	size_t numLocations() const override
+	{
+		return m_numLocations;
+	}
+
 	float evaluate(const Keyboard<NumLocations>& keyboard) const override
 	{
 		uint64_t sum = 0;
@@ -58,5 +72,6 @@ public:
 private:
 	std::array<std::array<int, NumLocations>, NumLocations> m_distances;
 	std::array<std::array<int, NumLocations>, NumLocations> m_flow;
+	size_t m_numLocations = NumLocations;
 };
 
@@ -0,0 +1,68 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include "BMAIslandOptimizer.hpp"
+#include "QAP.hpp"
+#include "Keyboard.hpp"
+
+using namespace testing;
+
+namespace
+{
+	template<size_t N>
+	BMAOptimizer<N, int64_t> chr12aSettings()
+	{
+		BMAOptimizer<N, int64_t> o(0);
+		o.crossover(CrossoverType::Uniform);
+		o.jumpMagnitude(0.05337941137576252f);
+		o.improvementDepth(4644);
+		o.perturbType(PerturbType::Normal);
+		o.minDirectedPertubation(0.07956319937402234f);
+		o.populationSize(7);
+		o.stagnation(792, 1.8702265013537944f, 9.90795080916275f);
+		o.tabuTenure(0.6740803228413664f, 0.7841240524741843f);
+		o.mutation(25, 0.887375951372175f, 10);
+		o.tournamentPool(4);
+		return o;
+	}
+}
+
+TEST(BMAIslandOptimizerTests, IslandsReachTheTarget)
+{
+	QAP<12, int64_t> objective("../../tests/QAPData/chr12a.dat");
+	auto prototype = chr12aSettings<12>();
+	prototype.target(-9552);
+	BMAIslandOptimizer<12, int64_t> o(4, 3);
+	o.migration(2, 2, MigrationTopology::Ring);
+	auto& solution = o.optimize(prototype, objective, 2000000);
+	EXPECT_EQ(-9552, std::get<0>(solution));
+	EXPECT_EQ(std::get<0>(solution), objective.evaluate(std::get<1>(solution)));
+}
+
+TEST(BMAIslandOptimizerTests, AllIslandsStopWhenOneReachesTheTarget)
+{
+	// Any solution reaches the target, so the islands must stop long before the evaluations run out
+	QAP<26, int64_t> objective("../../tests/QAPData/bur26a.dat");
+	BMAOptimizer<26, int64_t> prototype(0);
+	prototype.populationSize(4);
+	prototype.improvementDepth(100);
+	prototype.target(std::numeric_limits<int64_t>::lowest() + 1);
+	BMAIslandOptimizer<26, int64_t> o(3, 5);
+	o.migration(1, 1, MigrationTopology::Random);
+	o.optimize(prototype, objective, std::numeric_limits<int>::max());
+	EXPECT_LT(o.getNumEvaluations(), 3000000u);
+}
+
+TEST(BMAIslandOptimizerTests, MigrantsReplaceTheWorstSolution)
+{
+	QAP<12, int64_t> objective("../../tests/QAPData/chr12a.dat");
+	BMAOptimizer<12, int64_t> o(0);
+	o.populationSize(3);
+	o.improvementDepth(1);
+	o.optimize(objective, 100);
+	Keyboard<12> optimum;
+	optimum.m_keys = { 6, 4, 11, 1, 0, 2, 8, 10, 9, 5, 7, 3 };
+	o.immigrate(optimum, objective.evaluate(optimum));
+	EXPECT_EQ(-9552, std::get<0>(o.getBestSolution()));
+	EXPECT_EQ(-9552, std::get<0>(o.bestElites(1)[0]));
+	EXPECT_EQ(optimum.m_keys, std::get<1>(o.bestElites(1)[0]).m_keys);
+}
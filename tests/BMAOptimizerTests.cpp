@@ -54,4 +54,50 @@ TEST(BMAOptimizerTests, DecreasingOrder)
 	auto objective = TestObjective<3>(evaluate);
 	auto& solution = o.optimize(objective, 8);
 	EXPECT_THAT(std::get<1>(solution).m_keys, ElementsAre(2, 1, 0));
-}
\ No newline at end of file
+}
+// Exposes the move selection of the robust tabu search
+class RobustTabuOptimizer : public BMAOptimizer<4, int64_t>
+{
+public:
+	using BMAOptimizer<4, int64_t>::DeltaArray;
+	using BMAOptimizer<4, int64_t>::ExpiryArray;
+	using BMAOptimizer<4, int64_t>::aspirationAge;
+	using BMAOptimizer<4, int64_t>::robustTabuMove;
+};
+
+TEST(BMAOptimizerTests, RobustTabuForcesTheMovesThatHaveBeenAllowedForLong)
+{
+	RobustTabuOptimizer o;
+	Keyboard<4> keyboard;
+	RobustTabuOptimizer::DeltaArray delta = {};
+	delta[0][1] = 10;
+	delta[0][2] = 2;
+	delta[1][3] = -4;
+	delta[2][3] = -5;
+	const uint32_t iteration = 1000;
+	RobustTabuOptimizer::ExpiryArray tabu;
+	for (auto&& row : tabu)
+	{
+		row.fill(iteration - 1);
+	}
+	const auto bestMove = std::make_tuple(size_t(0), size_t(1), int64_t(10));
+	EXPECT_EQ(std::make_tuple(size_t(0), size_t(1)), o.robustTabuMove(delta, bestMove, tabu, keyboard, iteration, 0, 100));
+
+	// Only one of the keys needs to have been allowed back for long
+	const uint32_t longAgo = iteration - o.aspirationAge() - 1;
+	tabu[2][keyboard.m_keys[3]] = longAgo;
+	EXPECT_EQ(std::make_tuple(size_t(2), size_t(3)), o.robustTabuMove(delta, bestMove, tabu, keyboard, iteration, 0, 100));
+
+	// The best of the forced moves is made
+	tabu[3][keyboard.m_keys[1]] = longAgo;
+	EXPECT_EQ(std::make_tuple(size_t(1), size_t(3)), o.robustTabuMove(delta, bestMove, tabu, keyboard, iteration, 0, 100));
+
+	// A tabu move is made when it's forced, or leads to a new best solution
+	for (auto&& row : tabu)
+	{
+		row.fill(iteration + 10);
+	}
+	tabu[0][keyboard.m_keys[2]] = longAgo;
+	EXPECT_EQ(std::make_tuple(size_t(0), size_t(2)), o.robustTabuMove(delta, bestMove, tabu, keyboard, iteration, 0, 100));
+	EXPECT_EQ(std::make_tuple(size_t(0), size_t(1)), o.robustTabuMove(delta, bestMove, tabu, keyboard, iteration, 95, 100));
+}
@@ -0,0 +1,71 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include <thread>
+#include "Budget.hpp"
+
+using namespace testing;
+
+TEST(BudgetTests, EvaluationsRunOut)
+{
+	Budget<int64_t> budget;
+	budget.evaluations(10);
+	budget.start();
+	budget.consume(9);
+	EXPECT_FALSE(budget.exhausted(0));
+	EXPECT_EQ(9u, budget.evaluationsUsed());
+	budget.consume(1);
+	EXPECT_TRUE(budget.exhausted(0));
+	budget.start();
+	EXPECT_EQ(10, budget.evaluationsLeft());
+}
+
+TEST(BudgetTests, TargetIsReached)
+{
+	Budget<int64_t> budget;
+	budget.target(-100);
+	budget.start();
+	EXPECT_FALSE(budget.exhausted(-101));
+	EXPECT_TRUE(budget.exhausted(-100));
+	EXPECT_TRUE(budget.targetReached(-99));
+}
+
+TEST(BudgetTests, StopFlag)
+{
+	std::atomic<bool> stop(false);
+	Budget<> budget;
+	budget.stopFlag(&stop);
+	budget.start();
+	EXPECT_FALSE(budget.exhausted());
+	stop = true;
+	EXPECT_TRUE(budget.exhausted());
+}
+
+TEST(BudgetTests, WallTimeIsCheckedAtTheInterval)
+{
+	Budget<> budget;
+	budget.wallTime(0.01);
+	budget.checkInterval(4);
+	budget.start();
+	EXPECT_FALSE(budget.exhausted());
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	// The clock was read by the first call, so the next three calls use the cached result
+	EXPECT_FALSE(budget.exhausted());
+	EXPECT_FALSE(budget.exhausted());
+	EXPECT_FALSE(budget.exhausted());
+	EXPECT_TRUE(budget.exhausted());
+	EXPECT_TRUE(budget.exhausted());
+	EXPECT_GE(budget.timeElapsed(), 0.01);
+}
+
+TEST(BudgetTests, CpuTime)
+{
+	Budget<> budget;
+	budget.cpuTime(0.01);
+	budget.start();
+	volatile double sum = 0.0;
+	while (!budget.exhaustedNow())
+	{
+		sum = sum + 1.0;
+	}
+	EXPECT_GE(budget.cpuTimeElapsed(), 0.01);
+}
@@ -4,6 +4,11 @@
 #include "MakeArray.hpp"
 #include "NonDominatedSet.hpp"
 #include "Keyboard.hpp"
+#include "HashIndex.hpp"
+#include "DeltaCache.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <thread>
 
 using namespace testing;
 
@@ -51,4 +56,161 @@ template<typename... T>
 std::array<float, sizeof...(T)> make_solution_dimension(T&&... solutionDimensions)
 {
 	return make_array(std::forward<T>(solutionDimensions)...);
-}
\ No newline at end of file
+}
+TEST(HelpersTest, dispatchSizeSelectsTheSmallestSizeThatFits)
+{
+	auto dispatch = [](size_t size)
+	{
+		return dispatchSize(SizeList<4, 8, 16>(), size, [](auto s) { return decltype(s)::value; }, []() { return size_t(0); });
+	};
+	EXPECT_EQ(4, dispatch(1));
+	EXPECT_EQ(4, dispatch(4));
+	EXPECT_EQ(8, dispatch(5));
+	EXPECT_EQ(16, dispatch(16));
+	EXPECT_EQ(0, dispatch(17));
+}
+
+TEST(HelpersTest, HashIndexFindsInsertedPositions)
+{
+	detail::HashIndex index;
+	std::vector<uint64_t> hashes;
+	for (size_t i = 0; i < 1000; i++)
+	{
+		// Every hash is used twice, and the low bits collide often
+		hashes.push_back((i / 2) << 8);
+		index.insert(hashes.back(), i);
+	}
+	EXPECT_EQ(1000u, index.size());
+	for (size_t i = 0; i < 1000; i++)
+	{
+		EXPECT_EQ(i, index.find(hashes[i], [i](size_t position) { return position == i; }));
+	}
+	EXPECT_EQ(detail::HashIndex::NotFound, index.find(1, [](size_t) { return true; }));
+}
+
+TEST(HelpersTest, HashIndexErase)
+{
+	detail::HashIndex index;
+	for (size_t i = 0; i < 100; i++)
+	{
+		index.insert(i % 7, i);
+	}
+	for (size_t i = 0; i < 100; i += 2)
+	{
+		index.erase(i % 7, i);
+	}
+	EXPECT_EQ(50u, index.size());
+	for (size_t i = 0; i < 100; i++)
+	{
+		size_t expected = i % 2 == 0 ? detail::HashIndex::NotFound : i;
+		EXPECT_EQ(expected, index.find(i % 7, [i](size_t position) { return position == i; }));
+	}
+}
+
+TEST(HelpersTest, ScratchSpaceIsNotSharedByCopies)
+{
+	ScratchSpace<std::array<int, 4>> scratch;
+	scratch.get().fill(1);
+	ScratchSpace<std::array<int, 4>> copy(scratch);
+	EXPECT_NE(&scratch.get(), &copy.get());
+	EXPECT_EQ(&scratch.get(), &scratch.get());
+	copy.get().fill(2);
+	EXPECT_EQ(1, scratch.get()[0]);
+}
+
+TEST(HelpersTest, DeltaCacheEvictsTheOldestEntry)
+{
+	typedef detail::DeltaCache<4, int64_t> Cache;
+	Cache cache;
+	EXPECT_FALSE(cache.enabled());
+	cache.capacity(2 * sizeof(Cache::Entry));
+	EXPECT_TRUE(cache.enabled());
+	std::vector<Keyboard<4>> keyboards(3);
+	for (size_t i = 0; i < keyboards.size(); i++)
+	{
+		std::swap(keyboards[i].m_keys[0], keyboards[i].m_keys[i + 1]);
+		cache.insert(keyboards[i], keyboards[i].hash()).m_baseCost = static_cast<int64_t>(i);
+	}
+	EXPECT_EQ(2u, cache.size());
+	EXPECT_EQ(nullptr, cache.find(keyboards[0], keyboards[0].hash()));
+	ASSERT_NE(nullptr, cache.find(keyboards[2], keyboards[2].hash()));
+	EXPECT_EQ(2, cache.find(keyboards[2], keyboards[2].hash())->m_baseCost);
+	// Copies start empty
+	Cache copy(cache);
+	EXPECT_TRUE(copy.enabled());
+	EXPECT_EQ(0u, copy.size());
+}
+
+TEST(HelpersTest, DeltaCacheEntriesFollowTheSwaps)
+{
+	typedef detail::DeltaCache<64, int64_t> Cache;
+	Cache cache;
+	cache.capacity(sizeof(Cache::Entry));
+	Keyboard<64> keyboard;
+	Keyboard<64> swapped = keyboard;
+	std::swap(swapped.m_keys[1], swapped.m_keys[5]);
+	cache.insert(keyboard, keyboard.hash()).m_swaps.clear();
+	std::vector<Cache::Swap> swaps(1, Cache::Swap(1, 5));
+	EXPECT_TRUE(cache.extend(keyboard, keyboard.hash(), swapped, swapped.hash(), swaps));
+	EXPECT_EQ(nullptr, cache.find(keyboard, keyboard.hash()));
+	ASSERT_NE(nullptr, cache.find(swapped, swapped.hash()));
+	EXPECT_EQ(swaps, cache.find(swapped, swapped.hash())->m_swaps);
+	// Too many swaps to replay
+	swaps.assign(Cache::MaxSwaps, Cache::Swap(1, 5));
+	EXPECT_FALSE(cache.extend(swapped, swapped.hash(), keyboard, keyboard.hash(), swaps));
+	EXPECT_NE(nullptr, cache.find(swapped, swapped.hash()));
+}
+
+TEST(HelpersTest, SwapSequenceTurnsOneKeyboardIntoTheOther)
+{
+	std::mt19937 randomGenerator(4);
+	Keyboard<32> from;
+	from.randomize(randomGenerator);
+	Keyboard<32> to = from;
+	// Two cycles of three keys need two swaps each
+	std::swap(to.m_keys[1], to.m_keys[7]);
+	std::swap(to.m_keys[7], to.m_keys[20]);
+	std::swap(to.m_keys[3], to.m_keys[30]);
+	std::swap(to.m_keys[3], to.m_keys[11]);
+	std::vector<std::pair<uint16_t, uint16_t>> swaps;
+	ASSERT_TRUE(detail::swapSequence(from, to, 4, swaps));
+	EXPECT_EQ(4u, swaps.size());
+	Keyboard<32> k = from;
+	for (auto&& swap : swaps)
+	{
+		EXPECT_LT(swap.first, swap.second);
+		std::swap(k.m_keys[swap.first], k.m_keys[swap.second]);
+	}
+	EXPECT_EQ(to, k);
+	EXPECT_FALSE(detail::swapSequence(from, to, 3, swaps));
+	EXPECT_TRUE(detail::swapSequence(from, from, 0, swaps));
+	EXPECT_TRUE(swaps.empty());
+}
+
+TEST(HelpersTest, ThreadPoolRunsEveryTaskOnItsOwnThread)
+{
+	detail::ThreadPool pool(4);
+	ASSERT_EQ(4u, pool.size());
+	for (size_t run = 0; run < 100; run++)
+	{
+		std::vector<std::thread::id> ids(pool.size());
+		pool.run([&ids](size_t t) { ids[t] = std::this_thread::get_id(); });
+		EXPECT_EQ(std::this_thread::get_id(), ids[0]);
+		std::sort(ids.begin(), ids.end());
+		EXPECT_EQ(ids.end(), std::unique(ids.begin(), ids.end()));
+	}
+}
+
+TEST(HelpersTest, ThreadPoolRunsNestedCallsOnTheCallingThread)
+{
+	detail::ThreadPool pool(3);
+	std::vector<std::vector<std::thread::id>> ids(pool.size(), std::vector<std::thread::id>(pool.size()));
+	pool.run([&pool, &ids](size_t t)
+	{
+		pool.run([&ids, t](size_t u) { ids[t][u] = std::this_thread::get_id(); });
+	});
+	for (auto&& nested : ids)
+	{
+		EXPECT_THAT(nested, Each(nested[0]));
+	}
+}
@@ -0,0 +1,64 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include "Instrumentation.hpp"
+
+using namespace testing;
+
+TEST(InstrumentationTests, CountersAreCountedAndMerged)
+{
+	Instrumentation<true> first;
+	Instrumentation<true> second;
+	first.count(InstrumentationCounter::Iterations, 10);
+	first.count(InstrumentationCounter::Mutations);
+	second.count(InstrumentationCounter::Iterations, 5);
+	first.merge(second);
+	EXPECT_EQ(15u, first.counter(InstrumentationCounter::Iterations));
+	EXPECT_EQ(1u, first.counter(InstrumentationCounter::Mutations));
+	EXPECT_EQ(0u, first.counter(InstrumentationCounter::EliteRestarts));
+	first.clear();
+	EXPECT_EQ(0u, first.counter(InstrumentationCounter::Iterations));
+}
+
+TEST(InstrumentationTests, NestedPhasesAreExcluded)
+{
+	Instrumentation<true> instrumentation;
+	{
+		Instrumentation<true>::ScopedPhase descent(instrumentation, InstrumentationPhase::Descent);
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		{
+			Instrumentation<true>::ScopedPhase perturbation(instrumentation, InstrumentationPhase::Perturbation);
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+	}
+	EXPECT_GE(instrumentation.time(InstrumentationPhase::Perturbation), 0.05);
+	EXPECT_GE(instrumentation.time(InstrumentationPhase::Descent), 0.01);
+	// The sleeps can take longer than asked on a busy machine, so there's no upper bound. Only the time of the
+	// outer phase would include the time of the inner one if it wasn't excluded
+	EXPECT_LT(instrumentation.time(InstrumentationPhase::Descent), instrumentation.time(InstrumentationPhase::Perturbation));
+	EXPECT_EQ(0.0, instrumentation.time(InstrumentationPhase::Crossover));
+}
+
+TEST(InstrumentationTests, DisabledInstrumentationIsEmpty)
+{
+	EXPECT_TRUE(std::is_empty<Instrumentation<false>>::value);
+	Instrumentation<false> instrumentation;
+	instrumentation.count(InstrumentationCounter::Iterations);
+	EXPECT_EQ(0u, instrumentation.counter(InstrumentationCounter::Iterations));
+}
+
+TEST(InstrumentationTests, Json)
+{
+	Instrumentation<true> instrumentation;
+	instrumentation.count(InstrumentationCounter::DuplicateRejections, 3);
+	std::stringstream stream;
+	writeJson(stream, instrumentation);
+	EXPECT_THAT(stream.str(), StartsWith("{\"enabled\": true, \"counters\": {\"iterations\": 0, "));
+	EXPECT_THAT(stream.str(), HasSubstr("\"duplicate_rejections\": 3"));
+	EXPECT_THAT(stream.str(), HasSubstr("\"seconds\": {\"crossover\": 0, "));
+	std::stringstream disabled;
+	writeJson(disabled, Instrumentation<false>());
+	EXPECT_THAT(disabled.str(), StartsWith("{\"enabled\": false"));
+}
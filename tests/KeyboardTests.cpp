@@ -27,4 +27,35 @@ TEST(KeyboardTests, Randomize)
 	testKeyboard(KeyArray{ 1, 2, 0 });
 	testKeyboard(KeyArray{ 2, 0, 1 });
 	testKeyboard(KeyArray{ 2, 1, 0 });
-}
\ No newline at end of file
+}
+TEST(KeyboardTests, SwappedHashMatchesTheHashAfterTheSwap)
+{
+	Keyboard<12> k;
+	std::mt19937 randomGenerator(3);
+	k.randomize(randomGenerator);
+	uint64_t hash = k.hash();
+	for (size_t i = 0; i < 12; i++)
+	{
+		for (size_t j = i + 1; j < 12; j++)
+		{
+			hash = k.swappedHash(hash, i, j);
+			std::swap(k.m_keys[i], k.m_keys[j]);
+			EXPECT_EQ(k.hash(), hash);
+		}
+	}
+	Keyboard<12> other = k;
+	std::swap(other.m_keys[0], other.m_keys[1]);
+	EXPECT_NE(k.hash(), other.hash());
+}
+
+TEST(KeyboardTests, DistanceCountsTheDifferentPositions)
+{
+	Keyboard<40> k;
+	Keyboard<40> other = k;
+	EXPECT_EQ(0u, k.distance(other));
+	std::swap(other.m_keys[3], other.m_keys[39]);
+	EXPECT_EQ(2u, k.distance(other));
+	std::swap(other.m_keys[3], other.m_keys[17]);
+	EXPECT_EQ(3u, k.distance(other));
+	EXPECT_EQ(3u, other.distance(k));
+}
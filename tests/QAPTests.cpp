@@ -1,8 +1,11 @@
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
+#include <fstream>
+#include <cstdio>
 #include "QAP.hpp"
 #include "Keyboard.hpp"
 #include "BMAOptimizer.hpp"
+#include "TestUtilities.hpp"
 
 using namespace testing;
 
@@ -25,6 +28,39 @@ TEST(QAPTests, ObjectiveFunctionWorksCorrectlyTai30b)
 	EXPECT_EQ(-637117113, static_cast<int32_t>(objective.evaluate(keyboard)));
 }
 
+TEST(QAPTests, VectorizedEvaluationMatchesReference)
+{
+	std::string filename = "../../tests/QAPData/tai30b.dat";
+	std::ifstream stream(filename);
+	int numLocations;
+	stream >> numLocations;
+	std::array<std::array<int64_t, 30>, 30> distances;
+	std::array<std::array<int64_t, 30>, 30> flow;
+	for (auto& row : distances)
+		for (auto& v : row)
+			stream >> v;
+	for (auto& row : flow)
+		for (auto& v : row)
+			stream >> v;
+
+	QAP<30> objective(filename);
+	std::mt19937 randomGenerator(5);
+	for (size_t n = 0; n < 20; n++)
+	{
+		Keyboard<30> keyboard;
+		keyboard.randomize(randomGenerator);
+		uint64_t expected = 0;
+		for (size_t i = 0; i < 30; i++)
+		{
+			for (size_t j = 0; j < 30; j++)
+			{
+				expected += static_cast<uint64_t>(distances[i][j]) * static_cast<uint64_t>(flow[keyboard.m_keys[i]][keyboard.m_keys[j]]);
+			}
+		}
+		EXPECT_EQ(-static_cast<double>(expected), objective.evaluate(keyboard));
+	}
+}
+
 TEST(QAPTests, NeighbourhoodFunctionWorksCorrectly)
 {
 	std::string filename = "../../tests/QAPData/chr12a.dat";
@@ -78,6 +114,343 @@ TEST(QAPTests, SwappedNeighbourhoodFunctionWorksCorrectly)
 	}
 }
 
+template<size_t N, typename FloatingPoint = double>
+void checkBestMoveDuringRepeatedSwaps(const std::string& filename, QAPStorage storage = QAPStorage::Automatic)
+{
+	QAP<N, FloatingPoint> objective(filename, storage);
+	Keyboard<N> keyboard;
+	std::mt19937 randomGenerator(3);
+	keyboard.randomize(randomGenerator);
+	typename QAP<N, FloatingPoint>::DeltaArray delta;
+	auto searchState = objective.createSearchState();
+	FloatingPoint value = objective.evaluate(keyboard);
+	auto best = objective.evaluateNeighbourhoodBestMove(keyboard, value, QAP<N, FloatingPoint>::NoSwap, QAP<N, FloatingPoint>::NoSwap, delta, searchState.get());
+	// The overloads without a search state read the flow through the keyboard instead
+	typename QAP<N, FloatingPoint>::DeltaArray statelessDelta;
+	auto statelessBest = objective.evaluateNeighbourhoodBestMove(keyboard, value, QAP<N, FloatingPoint>::NoSwap, QAP<N, FloatingPoint>::NoSwap, statelessDelta);
+	std::uniform_int_distribution<size_t> dist(0, N - 1);
+	for (size_t n = 0; n < 50; n++)
+	{
+		size_t expectedI = 0;
+		size_t expectedJ = 0;
+		FloatingPoint expectedDelta = std::numeric_limits<FloatingPoint>::lowest();
+		for (size_t i = 0; i < N; i++)
+		{
+			for (size_t j = i + 1; j < N; j++)
+			{
+				Keyboard<N> k2 = keyboard;
+				std::swap(k2.m_keys[i], k2.m_keys[j]);
+				ASSERT_EQ(objective.evaluate(k2), value + delta[i][j]);
+				ASSERT_EQ(delta[i][j], statelessDelta[i][j]);
+				// The best move of a padded instance is only selected between the real locations
+				if (j < objective.numLocations() && delta[i][j] > expectedDelta)
+				{
+					expectedDelta = delta[i][j];
+					expectedI = i;
+					expectedJ = j;
+				}
+			}
+		}
+		EXPECT_EQ(std::make_tuple(expectedI, expectedJ, expectedDelta), best);
+		EXPECT_EQ(best, statelessBest);
+
+		size_t r = dist(randomGenerator);
+		size_t s = dist(randomGenerator);
+		if (r == s)
+			continue;
+		if (r > s)
+			std::swap(r, s);
+		value += delta[r][s];
+		std::swap(keyboard.m_keys[r], keyboard.m_keys[s]);
+		best = objective.evaluateNeighbourhoodBestMove(keyboard, value, r, s, delta, searchState.get());
+		statelessBest = objective.evaluateNeighbourhoodBestMove(keyboard, value, r, s, statelessDelta);
+	}
+}
+
+TEST(QAPTests, BestMoveIsSelectedDuringRepeatedSwaps)
+{
+	checkBestMoveDuringRepeatedSwaps<26>("../../tests/QAPData/bur26a.dat");
+}
+
+TEST(QAPTests, BestMoveIsSelectedDuringRepeatedSwapsSymmetric)
+{
+	checkBestMoveDuringRepeatedSwaps<30>("../../tests/QAPData/nug30.dat");
+}
+
+TEST(QAPTests, BestMoveIsSelectedDuringRepeatedSwapsSymmetricWithDiagonal)
+{
+	checkBestMoveDuringRepeatedSwaps<64>("../../tests/QAPData/tai64c.dat");
+}
+
+TEST(QAPTests, BestMoveIsSelectedDuringRepeatedSwapsExact)
+{
+	checkBestMoveDuringRepeatedSwaps<26, int64_t>("../../tests/QAPData/bur26a.dat");
+	checkBestMoveDuringRepeatedSwaps<64, int64_t>("../../tests/QAPData/esc64a.dat");
+}
+
+template<size_t N, typename FloatingPoint = double>
+void checkMoveEvaluationDuringRepeatedSwaps(const std::string& filename, QAPStorage storage = QAPStorage::Automatic)
+{
+	QAP<N, FloatingPoint> objective(filename, storage);
+	Keyboard<N> keyboard;
+	std::mt19937 randomGenerator(5);
+	keyboard.randomize(randomGenerator);
+	auto searchState = objective.createSearchState();
+	FloatingPoint value = objective.evaluate(keyboard);
+	size_t lastI = QAP<N, FloatingPoint>::NoSwap;
+	size_t lastJ = QAP<N, FloatingPoint>::NoSwap;
+	std::uniform_int_distribution<size_t> dist(0, N - 1);
+	for (size_t n = 0; n < 50; n++)
+	{
+		size_t i = dist(randomGenerator);
+		size_t j = dist(randomGenerator);
+		if (i == j)
+			continue;
+		if (i > j)
+			std::swap(i, j);
+		const FloatingPoint d = objective.evaluateMove(keyboard, value, lastI, lastJ, i, j, searchState.get());
+		// Without a search state the move is evaluated from scratch
+		ASSERT_EQ(d, objective.evaluateMove(keyboard, value, QAP<N, FloatingPoint>::NoSwap, QAP<N, FloatingPoint>::NoSwap, i, j, nullptr));
+		Keyboard<N> k2 = keyboard;
+		std::swap(k2.m_keys[i], k2.m_keys[j]);
+		ASSERT_EQ(objective.evaluate(k2), value + d);
+		// Every other move is made, so the state follows some of the swaps and some of the moves are evaluated twice
+		if (n % 2 == 0)
+		{
+			keyboard = k2;
+			value += d;
+			lastI = i;
+			lastJ = j;
+		}
+		else
+		{
+			lastI = QAP<N, FloatingPoint>::NoSwap;
+			lastJ = QAP<N, FloatingPoint>::NoSwap;
+		}
+	}
+}
+
+TEST(QAPTests, MoveEvaluationDuringRepeatedSwaps)
+{
+	checkMoveEvaluationDuringRepeatedSwaps<26>("../../tests/QAPData/bur26a.dat");
+	checkMoveEvaluationDuringRepeatedSwaps<30>("../../tests/QAPData/nug30.dat");
+	checkMoveEvaluationDuringRepeatedSwaps<64>("../../tests/QAPData/tai64c.dat");
+	checkMoveEvaluationDuringRepeatedSwaps<26, int64_t>("../../tests/QAPData/bur26a.dat");
+	checkMoveEvaluationDuringRepeatedSwaps<64, int64_t>("../../tests/QAPData/esc64a.dat");
+	checkMoveEvaluationDuringRepeatedSwaps<26>("../../tests/QAPData/bur26a.dat", QAPStorage::Sparse);
+}
+
+TEST(QAPTests, ExactCostsAboveTheFloatPrecision)
+{
+	std::string filename = "../../tests/QAPData/tai256c.dat";
+	std::ifstream stream(filename);
+	size_t n;
+	stream >> n;
+	std::vector<int64_t> a(n * n), b(n * n);
+	for (auto&& v : a)
+	{
+		stream >> v;
+	}
+	for (auto&& v : b)
+	{
+		stream >> v;
+	}
+	QAP<256, int64_t> objective(filename);
+	Keyboard<256> keyboard;
+	std::mt19937 randomGenerator(11);
+	for (size_t k = 0; k < 5; k++)
+	{
+		keyboard.randomize(randomGenerator);
+		int64_t expected = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				expected += a[i * n + j] * b[keyboard.m_keys[i] * n + keyboard.m_keys[j]];
+			}
+		}
+		EXPECT_EQ(-expected, objective.evaluate(keyboard));
+	}
+}
+
+template<size_t N>
+void checkValueRange(int64_t maxDistance, const std::string& filename)
+{
+	std::mt19937 randomGenerator(5);
+	std::uniform_int_distribution<int64_t> distanceDist(0, maxDistance);
+	std::uniform_int_distribution<int64_t> flowDist(0, 3);
+	std::array<std::array<int64_t, N>, N> distances;
+	std::array<std::array<int64_t, N>, N> flow;
+	for (size_t i = 0; i < N; i++)
+	{
+		for (size_t j = 0; j < N; j++)
+		{
+			distances[i][j] = distanceDist(randomGenerator);
+			flow[i][j] = flowDist(randomGenerator);
+		}
+	}
+	distances[1][2] = maxDistance;
+	{
+		std::ofstream stream(filename);
+		stream << N << std::endl;
+		for (auto&& row : distances)
+		{
+			for (auto v : row)
+			{
+				stream << v << " ";
+			}
+			stream << std::endl;
+		}
+		for (auto&& row : flow)
+		{
+			for (auto v : row)
+			{
+				stream << v << " ";
+			}
+			stream << std::endl;
+		}
+	}
+
+	QAP<N> objective(filename);
+	Keyboard<N> keyboard;
+	for (size_t n = 0; n < 10; n++)
+	{
+		keyboard.randomize(randomGenerator);
+		int64_t expected = 0;
+		for (size_t i = 0; i < N; i++)
+		{
+			for (size_t j = 0; j < N; j++)
+			{
+				expected += distances[i][j] * flow[keyboard.m_keys[i]][keyboard.m_keys[j]];
+			}
+		}
+		EXPECT_EQ(-static_cast<double>(expected), objective.evaluate(keyboard));
+	}
+	checkBestMoveDuringRepeatedSwaps<N>(filename);
+}
+
+TEST(QAPTests, ValuesAtTheLimitsOfTheNarrowStorageTypes)
+{
+	checkValueRange<20>(std::numeric_limits<int8_t>::max(), "qap_value_range.dat");
+	checkValueRange<20>(std::numeric_limits<int8_t>::max() + 1, "qap_value_range.dat");
+	checkValueRange<20>(std::numeric_limits<int16_t>::max(), "qap_value_range.dat");
+	checkValueRange<20>(std::numeric_limits<int16_t>::max() + 1, "qap_value_range.dat");
+	checkValueRange<20>(std::numeric_limits<int32_t>::max(), "qap_value_range.dat");
+	checkValueRange<20>(static_cast<int64_t>(std::numeric_limits<int32_t>::max()) + 1, "qap_value_range.dat");
+	std::remove("qap_value_range.dat");
+}
+
+TEST(QAPTests, SparseStorageIsSelectedForSparseInstances)
+{
+	EXPECT_TRUE(QAP<64>("../../tests/QAPData/esc64a.dat").isSparse());
+	EXPECT_TRUE(QAP<128>("../../tests/QAPData/esc128.dat").isSparse());
+	EXPECT_TRUE(QAP<256>("../../tests/QAPData/tai256c.dat").isSparse());
+	EXPECT_FALSE(QAP<30>("../../tests/QAPData/nug30.dat").isSparse());
+	EXPECT_FALSE(QAP<26>("../../tests/QAPData/bur26a.dat").isSparse());
+}
+
+TEST(QAPTests, SparseEvaluationMatchesDense)
+{
+	std::string filename = "../../tests/QAPData/esc128.dat";
+	QAP<128> sparse(filename, QAPStorage::Sparse);
+	QAP<128> dense(filename, QAPStorage::Dense);
+	Keyboard<128> keyboard;
+	std::mt19937 randomGenerator(7);
+	for (size_t n = 0; n < 20; n++)
+	{
+		keyboard.randomize(randomGenerator);
+		EXPECT_EQ(dense.evaluate(keyboard), sparse.evaluate(keyboard));
+	}
+}
+
+TEST(QAPTests, BestMoveIsSelectedDuringRepeatedSwapsSparse)
+{
+	checkBestMoveDuringRepeatedSwaps<64>("../../tests/QAPData/esc64a.dat");
+}
+
+TEST(QAPTests, BestMoveIsSelectedDuringRepeatedSwapsSparseAsymmetric)
+{
+	checkBestMoveDuringRepeatedSwaps<26>("../../tests/QAPData/bur26a.dat", QAPStorage::Sparse);
+}
+
+TEST(QAPTests, SmallerInstancesArePadded)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<14> objective(filename);
+	EXPECT_EQ(12, objective.numLocations());
+	Keyboard<14> keyboard;
+	keyboard.m_keys = { 6, 4, 11, 1, 0, 2, 8, 10, 9, 5, 7, 3, 12, 13 };
+	EXPECT_EQ(-9552, objective.evaluate(keyboard));
+	checkBestMoveDuringRepeatedSwaps<16>(filename);
+}
+
+template<size_t N>
+std::tuple<int64_t, std::vector<unsigned char>, size_t> chr12aRun(unsigned int seed, PerturbType perturbType)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<N, int64_t> objective(filename);
+	BMAOptimizer<N, int64_t> o(seed);
+	o.crossover(CrossoverType::PartiallyMatched);
+	o.perturbType(perturbType);
+	o.improvementDepth(200);
+	o.populationSize(5);
+	o.tabuTenure(0.6740803228413664f, 0.7841240524741843f);
+	o.mutation(5, 0.5f, 3);
+	auto solution = o.optimize(objective, 200000);
+	auto& keys = std::get<1>(solution).m_keys;
+	for (size_t i = objective.numLocations(); i < N; i++)
+	{
+		EXPECT_EQ(i, keys[i]);
+	}
+	return std::make_tuple(std::get<0>(solution), std::vector<unsigned char>(keys.begin(), keys.begin() + 12), o.getNumEvaluations());
+}
+
+TEST(QAPTests, PaddedRunsMatchTheRealSize)
+{
+	// The dummy keys stay in place, and the moves, the parameters and the evaluations all scale with the real size
+	EXPECT_EQ(chr12aRun<12>(2, PerturbType::Normal), chr12aRun<14>(2, PerturbType::Normal));
+	EXPECT_EQ(chr12aRun<12>(3, PerturbType::Annealed), chr12aRun<16>(3, PerturbType::Annealed));
+	EXPECT_EQ(chr12aRun<12>(4, PerturbType::RobustTabu), chr12aRun<14>(4, PerturbType::RobustTabu));
+}
+
+TEST(QAPTests, CachedInstanceMatchesTheTextFile)
+{
+	std::string filename = "../../tests/QAPData/tai30b.dat";
+	std::string cacheFilename = "qap_instance_cache.qapbin";
+	std::remove(cacheFilename.c_str());
+	auto parsed = detail::loadQAPInstance(filename, cacheFilename);
+	auto cached = detail::loadQAPInstance(filename, cacheFilename);
+	auto mapped = detail::loadQAPInstance(cacheFilename);
+	EXPECT_EQ(30, cached.m_numLocations);
+	EXPECT_EQ(parsed.m_valueType, cached.m_valueType);
+	EXPECT_EQ(parsed.m_valueType, mapped.m_valueType);
+	for (size_t i = 0; i < 30; i++)
+	{
+		for (size_t j = 0; j < 30; j++)
+		{
+			EXPECT_EQ(parsed.distance(i, j), cached.distance(i, j));
+			EXPECT_EQ(parsed.flow(i, j), cached.flow(i, j));
+			EXPECT_EQ(parsed.distance(i, j), mapped.distance(i, j));
+			EXPECT_EQ(parsed.flow(i, j), mapped.flow(i, j));
+		}
+	}
+
+	QAP<30> text(filename);
+	QAP<30> objective(cached);
+	QAP<32> padded(mapped);
+	Keyboard<30> keyboard;
+	Keyboard<32> paddedKeyboard;
+	std::mt19937 randomGenerator(3);
+	for (size_t n = 0; n < 10; n++)
+	{
+		keyboard.randomize(randomGenerator);
+		std::copy(keyboard.m_keys.begin(), keyboard.m_keys.end(), paddedKeyboard.m_keys.begin());
+		EXPECT_EQ(text.evaluate(keyboard), objective.evaluate(keyboard));
+		EXPECT_EQ(text.evaluate(keyboard), padded.evaluate(paddedKeyboard));
+	}
+	std::remove(cacheFilename.c_str());
+}
+
 TEST(QAPTests, QAPchr12a)
 {
 	std::string filename = "../../tests/QAPData/chr12a.dat";
@@ -99,3 +472,389 @@ TEST(QAPTests, QAPchr12a)
 	int resultValue = static_cast<int>(-std::round(std::get<0>(solution)));
 	EXPECT_EQ(9552, resultValue);
 }
+
+TEST(QAPTests, QAPchr12aExact)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<12, int64_t> objective(filename);
+	// The budget is big enough for every seed, the runs stop at the target long before it's used up
+	for (unsigned int seed = 0; seed < 5; seed++)
+	{
+		BMAOptimizer<12, int64_t> o(seed);
+		o.crossover(CrossoverType::Uniform);
+		o.jumpMagnitude(0.05337941137576252f);
+		o.improvementDepth(4644);
+		o.perturbType(PerturbType::Normal);
+		o.minDirectedPertubation(0.07956319937402234f);
+		o.populationSize(7);
+		o.stagnation(792, 1.8702265013537944f, 9.90795080916275f);
+		o.tabuTenure(0.6740803228413664f, 0.7841240524741843f);
+		o.mutation(25, 0.887375951372175f, 10);
+		o.tournamentPool(4);
+		o.target(-9552);
+		auto& solution = o.optimize(objective, 20000000);
+		EXPECT_EQ(-9552, std::get<0>(solution)) << "seed " << seed;
+		EXPECT_EQ(std::get<0>(solution), objective.evaluate(std::get<1>(solution)));
+	}
+}
+
+TEST(QAPTests, QAPchr12aRobustTabu)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<12, int64_t> objective(filename);
+	BMAOptimizer<12, int64_t> o(1);
+	o.perturbType(PerturbType::RobustTabu);
+	o.populationSize(5);
+	o.improvementDepth(2000);
+	o.tabuTenure(0.9f, 1.1f);
+	o.target(-9552);
+	auto& solution = o.optimize(objective, 2000000);
+	EXPECT_EQ(-9552, std::get<0>(solution));
+	EXPECT_EQ(std::get<0>(solution), objective.evaluate(std::get<1>(solution)));
+}
+
+TEST(QAPTests, QAPchr12aQualityAndDistanceReplacement)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<12, int64_t> objective(filename);
+	auto run = [&objective]()
+	{
+		BMAOptimizer<12, int64_t> o(2);
+		o.crossover(CrossoverType::Uniform);
+		o.improvementDepth(1000);
+		o.populationSize(7);
+		o.replacement(ReplacementType::QualityAndDistance);
+		o.goodnessScore(0.6f, 0.3f);
+		o.threads(2);
+		o.target(-9552);
+		auto solution = o.optimize(objective, 2000000);
+		return std::make_tuple(std::get<0>(solution), std::get<1>(solution), o.getNumEvaluations());
+	};
+	auto first = run();
+	EXPECT_EQ(-9552, std::get<0>(first));
+	EXPECT_EQ(std::get<0>(first), objective.evaluate(std::get<1>(first)));
+	auto second = run();
+	EXPECT_EQ(std::get<1>(first).m_keys, std::get<1>(second).m_keys);
+	EXPECT_EQ(std::get<2>(first), std::get<2>(second));
+}
+
+TEST(QAPTests, QAPchr12aFirstImprovementDescent)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<12, int64_t> objective(filename);
+	uint64_t cacheHits = 0;
+	auto run = [&objective, &cacheHits](DescentType descentType, size_t passes, size_t cacheBytes)
+	{
+		BMAOptimizer<12, int64_t> o(4);
+		// Short searches, so that the run takes enough generations to start searches from the cached keyboards
+		o.improvementDepth(50);
+		o.populationSize(5);
+		o.descent(descentType, passes);
+		o.deltaCache(cacheBytes);
+		o.threads(2);
+		o.target(-9552);
+		auto solution = o.optimize(objective, 2000000);
+		cacheHits = o.getInstrumentation().counter(InstrumentationCounter::DeltaCacheHits);
+		return std::make_tuple(std::get<0>(solution), std::get<1>(solution).m_keys, o.getNumEvaluations());
+	};
+	for (size_t passes : { 1, 3 })
+	{
+		auto first = run(DescentType::FirstImprovement, passes, 0);
+		EXPECT_EQ(-9552, std::get<0>(first));
+		Keyboard<12> keyboard;
+		keyboard.m_keys = std::get<1>(first);
+		EXPECT_EQ(std::get<0>(first), objective.evaluate(keyboard));
+		EXPECT_EQ(first, run(DescentType::FirstImprovement, passes, 0));
+		EXPECT_EQ(0u, cacheHits);
+		// The searches from the cached keyboards skip the first improvement descent, so the course of the run changes
+		auto cached = run(DescentType::FirstImprovement, passes, 1 << 20);
+		EXPECT_EQ(-9552, std::get<0>(cached));
+		EXPECT_GT(cacheHits, 0u);
+		EXPECT_EQ(cached, run(DescentType::FirstImprovement, passes, 1 << 20));
+	}
+}
+
+// Runs single local searches with a delta cache that the test fills
+class CachedSearchOptimizer : public BMAOptimizer<12, int64_t>
+{
+public:
+	CachedSearchOptimizer() : BMAOptimizer<12, int64_t>(1)
+	{
+		descent(DescentType::FirstImprovement);
+		deltaCache(1 << 20);
+	}
+
+	void cache(const Keyboard<12>& keyboard, const QAP<12, int64_t>& objective)
+	{
+		auto& entry = m_deltaCache.insert(keyboard, keyboard.hash());
+		entry.m_base = keyboard;
+		entry.m_baseCost = objective.evaluate(keyboard);
+		entry.m_bestMove = objective.evaluateNeighbourhoodBestMove(keyboard, entry.m_baseCost, Objective<12, int64_t>::NoSwap, Objective<12, int64_t>::NoSwap, entry.m_delta);
+		entry.m_swaps.clear();
+	}
+
+	int64_t search(const Keyboard<12>& keyboard, const QAP<12, int64_t>& objective)
+	{
+		m_instrumentation.clear();
+		m_budget.evaluations(1000000);
+		m_budget.start();
+		return std::get<1>(localSearch(keyboard, objective.evaluate(keyboard), keyboard.hash(), 10, true, objective));
+	}
+};
+
+TEST(QAPTests, QAPchr12aFirstImprovementDescentIsSkippedFromCachedKeyboards)
+{
+	QAP<12, int64_t> objective("../../tests/QAPData/chr12a.dat");
+	CachedSearchOptimizer o;
+	Keyboard<12> keyboard;
+	std::mt19937 randomGenerator(3);
+	keyboard.randomize(randomGenerator);
+	const int64_t cost = o.search(keyboard, objective);
+	EXPECT_GT(cost, objective.evaluate(keyboard));
+	EXPECT_EQ(0u, o.getInstrumentation().counter(InstrumentationCounter::DeltaCacheHits));
+	EXPECT_GT(o.getInstrumentation().counter(InstrumentationCounter::MoveEvaluations), 0u);
+
+	// The random keyboard isn't a local optimum, so a first improvement descent from it would move away from the cached matrix
+	o.cache(keyboard, objective);
+	EXPECT_GT(o.search(keyboard, objective), objective.evaluate(keyboard));
+	EXPECT_EQ(1u, o.getInstrumentation().counter(InstrumentationCounter::DeltaCacheHits));
+	EXPECT_EQ(0u, o.getInstrumentation().counter(InstrumentationCounter::MoveEvaluations));
+}
+
+template<typename RandomGenerator>
+void checkReproducibleThreadedRuns()
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<12, int64_t> objective(filename);
+	auto run = [&objective]()
+	{
+		BMAOptimizer<12, int64_t, RandomGenerator> o(4);
+		o.crossover(CrossoverType::Uniform);
+		o.improvementDepth(1000);
+		o.populationSize(7);
+		o.threads(3);
+		o.target(-9552);
+		auto solution = o.optimize(objective, 2000000);
+		return std::make_tuple(std::get<0>(solution), std::get<1>(solution).m_keys, o.getNumEvaluations());
+	};
+	auto first = run();
+	EXPECT_EQ(-9552, std::get<0>(first));
+	EXPECT_EQ(first, run());
+}
+
+TEST(QAPTests, QAPchr12aRandomGeneratorsGiveReproducibleThreadedRuns)
+{
+	checkReproducibleThreadedRuns<Xoshiro256StarStar>();
+	checkReproducibleThreadedRuns<Philox4x32>();
+	checkReproducibleThreadedRuns<std::mt19937>();
+}
+
+TEST(QAPTests, QAPchr12aThreaded)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<12, int64_t> objective(filename);
+	auto run = [&objective](unsigned int seed)
+	{
+		BMAOptimizer<12, int64_t> o(seed);
+		o.crossover(CrossoverType::Uniform);
+		o.jumpMagnitude(0.05337941137576252f);
+		o.improvementDepth(4644);
+		o.perturbType(PerturbType::Normal);
+		o.minDirectedPertubation(0.07956319937402234f);
+		o.populationSize(7);
+		o.stagnation(792, 1.8702265013537944f, 9.90795080916275f);
+		o.tabuTenure(0.6740803228413664f, 0.7841240524741843f);
+		o.mutation(25, 0.887375951372175f, 10);
+		o.tournamentPool(4);
+		o.threads(4);
+		o.target(-9552);
+		auto solution = o.optimize(objective, 2000000);
+		return std::make_tuple(std::get<0>(solution), std::get<1>(solution), o.getNumEvaluations());
+	};
+	auto first = run(1);
+	EXPECT_EQ(-9552, std::get<0>(first));
+	EXPECT_EQ(std::get<0>(first), objective.evaluate(std::get<1>(first)));
+	// The children are merged in a fixed order, so the same seed gives the same run
+	auto second = run(1);
+	EXPECT_EQ(std::get<1>(first).m_keys, std::get<1>(second).m_keys);
+	EXPECT_EQ(std::get<2>(first), std::get<2>(second));
+}
+
+TEST(QAPTests, QAPchr12aResumesFromACheckpoint)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	TemporaryFile checkpointFile("QAPTests_chr12a.checkpoint");
+	const std::string& checkpoint = checkpointFile.filename();
+	QAP<12, int64_t> objective(filename);
+	std::atomic<bool> stop(false);
+	std::vector<Snapshot<12, int64_t>> snapshots;
+	auto run = [&](size_t stopAfterGenerations)
+	{
+		BMAOptimizer<12, int64_t> o(7);
+		o.crossover(CrossoverType::Uniform);
+		o.improvementDepth(500);
+		o.populationSize(7);
+		o.mutation(25, 0.887375951372175f, 10);
+		o.threads(2);
+		o.snapshotSink([&snapshots](const Snapshot<12, int64_t>& snapshot) { snapshots.push_back(snapshot); });
+		o.checkpoint(checkpoint, 1000.0);
+		o.stopFlag(&stop);
+		size_t generation = 0;
+		o.generationCallback([&]()
+		{
+			if (++generation == stopAfterGenerations)
+			{
+				stop = true;
+			}
+		});
+		o.optimize(objective, 300000);
+		return o;
+	};
+	auto uninterrupted = run(0);
+	auto uninterruptedSnapshots = snapshots;
+	ASSERT_FALSE(uninterruptedSnapshots.empty());
+	snapshots.clear();
+	// A finished run removes its checkpoint
+	EXPECT_FALSE(std::ifstream(checkpoint).good());
+	run(3);
+	ASSERT_TRUE(std::ifstream(checkpoint).good());
+	stop = false;
+	auto resumed = run(0);
+	EXPECT_FALSE(std::ifstream(checkpoint).good());
+	EXPECT_EQ(0u, resumed.getNumCheckpointFailures());
+	EXPECT_EQ(std::get<1>(uninterrupted.getBestSolution()).m_keys, std::get<1>(resumed.getBestSolution()).m_keys);
+	EXPECT_EQ(uninterrupted.getNumEvaluations(), resumed.getNumEvaluations());
+	// The snapshots of the interrupted and the resumed run together are the snapshots of the uninterrupted run
+	ASSERT_EQ(uninterruptedSnapshots.size(), snapshots.size());
+	for (size_t i = 0; i < snapshots.size(); i++)
+	{
+		EXPECT_EQ(uninterruptedSnapshots[i].m_evaluations, snapshots[i].m_evaluations);
+		EXPECT_EQ(uninterruptedSnapshots[i].m_solution, snapshots[i].m_solution);
+	}
+}
+
+TEST(QAPTests, QAPchr12aCountsTheCheckpointsThatCantBeWritten)
+{
+	QAP<12, int64_t> objective("../../tests/QAPData/chr12a.dat");
+	TemporaryFile missingDirectory("QAPTests_missing_directory");
+	std::atomic<bool> stop(false);
+	BMAOptimizer<12, int64_t> o(7);
+	o.populationSize(5);
+	o.improvementDepth(100);
+	o.checkpoint(missingDirectory.filename() + "/chr12a.checkpoint", 0.0);
+	o.stopFlag(&stop);
+	size_t generation = 0;
+	o.generationCallback([&]()
+	{
+		if (++generation == 3)
+		{
+			stop = true;
+		}
+	});
+	o.optimize(objective, 300000);
+	// Every generation and the stop try to write a checkpoint, and the run goes on without them
+	EXPECT_EQ(4u, o.getNumCheckpointFailures());
+}
+
+TEST(QAPTests, QAPchr12aDeltaCacheDoesNotChangeTheRun)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<12, int64_t> objective(filename);
+	auto run = [&objective](size_t cacheBytes, PerturbType perturbType, size_t numThreads)
+	{
+		BMAOptimizer<12, int64_t> o(3);
+		o.perturbType(perturbType);
+		o.improvementDepth(300);
+		// Mutations of a single swap, which the cached matrices follow
+		o.populationSize(3);
+		o.mutation(2, 0.5f, 10);
+		o.threads(numThreads);
+		o.deltaCache(cacheBytes);
+		auto solution = o.optimize(objective, 300000);
+		return std::make_tuple(std::get<0>(solution), std::get<1>(solution).m_keys, o.getNumEvaluations());
+	};
+	for (auto perturbType : { PerturbType::Normal, PerturbType::RobustTabu })
+	{
+		for (size_t numThreads : { 1, 2 })
+		{
+			EXPECT_EQ(run(0, perturbType, numThreads), run(1 << 20, perturbType, numThreads));
+			// A cache of a few entries evicts all the time
+			EXPECT_EQ(run(0, perturbType, numThreads), run(4096, perturbType, numThreads));
+		}
+	}
+}
+
+TEST(QAPTests, QAPchr12aEliteArchiveIsBounded)
+{
+	std::string filename = "../../tests/QAPData/chr12a.dat";
+	QAP<12, int64_t> objective(filename);
+	BMAOptimizer<12, int64_t> o(5);
+	o.improvementDepth(200);
+	o.populationSize(5);
+	o.mutation(2, 0.5f, 2);
+	o.eliteArchive(8, 0.25f);
+	auto& solution = o.optimize(objective, 500000);
+	auto elites = o.bestElites(100);
+	EXPECT_EQ(8u, elites.size());
+	// Only better solutions replace elites, so the best one is never lost
+	EXPECT_EQ(std::get<0>(solution), std::get<0>(elites[0]));
+}
+
+template<size_t N>
+void checkInitialNeighbourhood(const std::string& filename, size_t numThreads)
+{
+	QAP<N, int64_t> objective(filename, QAPStorage::Dense);
+	objective.threads(numThreads);
+	Keyboard<N> keyboard;
+	std::mt19937 randomGenerator(9);
+	keyboard.randomize(randomGenerator);
+	typename QAP<N, int64_t>::DeltaArray delta;
+	int64_t value = objective.evaluate(keyboard);
+	objective.evaluateFirstNeighbourhood(keyboard, value, delta);
+	for (size_t i = 0; i < N; i++)
+	{
+		for (size_t j = i + 1; j < N; j++)
+		{
+			Keyboard<N> k2 = keyboard;
+			std::swap(k2.m_keys[i], k2.m_keys[j]);
+			ASSERT_EQ(objective.evaluate(k2), value + delta[i][j]);
+		}
+	}
+}
+
+TEST(QAPTests, InitialNeighbourhoodOfLargeInstances)
+{
+	checkInitialNeighbourhood<150>("../../tests/QAPData/tai150b.dat", 1);
+	checkInitialNeighbourhood<150>("../../tests/QAPData/tai150b.dat", 3);
+	checkInitialNeighbourhood<150>("../../tests/QAPData/tho150.dat", 4);
+	checkInitialNeighbourhood<128>("../../tests/QAPData/esc128.dat", 2);
+}
+
+TEST(QAPTests, InitialNeighbourhoodOnASharedThreadPool)
+{
+	auto pool = std::make_shared<detail::ThreadPool>(3);
+	QAP<150, int64_t> objective("../../tests/QAPData/tai150b.dat", QAPStorage::Dense);
+	objective.threadPool(pool);
+	Keyboard<150> keyboard;
+	std::mt19937 randomGenerator(9);
+	keyboard.randomize(randomGenerator);
+	const int64_t value = objective.evaluate(keyboard);
+	QAP<150, int64_t>::DeltaArray delta;
+	objective.evaluateFirstNeighbourhood(keyboard, value, delta);
+	// From the threads of the pool, like the workers of the optimizer, the neighbourhood is built on the calling thread
+	std::vector<QAP<150, int64_t>::DeltaArray> workerDeltas(pool->size());
+	pool->run([&](size_t t)
+	{
+		objective.evaluateFirstNeighbourhood(keyboard, value, workerDeltas[t]);
+	});
+	for (auto&& workerDelta : workerDeltas)
+	{
+		for (size_t i = 0; i < 150; i++)
+		{
+			for (size_t j = i + 1; j < 150; j++)
+			{
+				ASSERT_EQ(delta[i][j], workerDelta[i][j]);
+			}
+		}
+	}
+}
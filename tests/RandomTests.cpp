@@ -0,0 +1,104 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include "Random.hpp"
+
+using namespace testing;
+
+TEST(RandomTests, Xoshiro256StarStarMatchesTheReferenceImplementation)
+{
+	Xoshiro256StarStar generator;
+	generator.state({ 1, 2, 3, 4 });
+	EXPECT_EQ(11520u, generator());
+	EXPECT_EQ(0u, generator());
+	EXPECT_EQ(1509978240u, generator());
+	EXPECT_EQ(1215971899390074240u, generator());
+}
+
+TEST(RandomTests, Philox4x32MatchesTheReferenceImplementation)
+{
+	EXPECT_THAT(Philox4x32::block({ 0, 0, 0, 0 }, { 0, 0 }), ElementsAre(0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u));
+	EXPECT_THAT(Philox4x32::block({ 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff }, { 0xffffffff, 0xffffffff }),
+		ElementsAre(0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu));
+	EXPECT_THAT(Philox4x32::block({ 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }, { 0xa4093822, 0x299f31d0 }),
+		ElementsAre(0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u));
+}
+
+TEST(RandomTests, Philox4x32ReturnsTheBlocksOfTheStream)
+{
+	Philox4x32 generator(0x299f31d0a4093822ull, 0x0370734413198a2eull);
+	auto block = Philox4x32::block({ 0, 0, 0x13198a2e, 0x03707344 }, { 0xa4093822, 0x299f31d0 });
+	EXPECT_EQ((uint64_t(block[1]) << 32) | block[0], generator());
+	EXPECT_EQ((uint64_t(block[3]) << 32) | block[2], generator());
+	block = Philox4x32::block({ 1, 0, 0x13198a2e, 0x03707344 }, { 0xa4093822, 0x299f31d0 });
+	EXPECT_EQ((uint64_t(block[1]) << 32) | block[0], generator());
+}
+
+template<typename RandomGenerator>
+class RandomStreamTests : public Test
+{
+};
+
+typedef Types<Xoshiro256StarStar, Philox4x32, std::mt19937, std::mt19937_64> RandomGenerators;
+TYPED_TEST_CASE(RandomStreamTests, RandomGenerators);
+
+TYPED_TEST(RandomStreamTests, StreamsAreReproducibleAndDifferent)
+{
+	auto a = detail::randomStream<TypeParam>(5, 0);
+	auto b = detail::randomStream<TypeParam>(5, 0);
+	auto c = detail::randomStream<TypeParam>(5, 1);
+	auto d = detail::randomStream<TypeParam>(6, 0);
+	size_t numSame = 0;
+	for (int i = 0; i < 100; i++)
+	{
+		const auto x = a();
+		EXPECT_EQ(x, b());
+		const auto y = c();
+		const auto z = d();
+		numSame += (x == y) + (x == z);
+	}
+	EXPECT_EQ(0u, numSame);
+}
+
+TYPED_TEST(RandomStreamTests, IndicesAreUniform)
+{
+	auto generator = detail::randomStream<TypeParam>(1, 0);
+	std::array<size_t, 7> counts = {};
+	const size_t numDraws = 70000;
+	for (size_t i = 0; i < numDraws; i++)
+	{
+		counts[detail::randomIndex(generator, counts.size())]++;
+	}
+	for (auto&& count : counts)
+	{
+		EXPECT_NEAR(10000.0, static_cast<double>(count), 500.0);
+	}
+}
+
+TYPED_TEST(RandomStreamTests, FloatsAreInTheRange)
+{
+	auto generator = detail::randomStream<TypeParam>(2, 0);
+	double sum = 0.0;
+	for (int i = 0; i < 10000; i++)
+	{
+		const float f = detail::randomFloat(generator, 2.0f, 3.0f);
+		ASSERT_GE(f, 2.0f);
+		ASSERT_LT(f, 3.0f);
+		sum += f;
+	}
+	EXPECT_NEAR(2.5, sum / 10000, 0.02);
+}
+
+TYPED_TEST(RandomStreamTests, ShuffleIsAPermutation)
+{
+	auto generator = detail::randomStream<TypeParam>(3, 0);
+	std::vector<int> values(50);
+	std::iota(values.begin(), values.end(), 0);
+	auto shuffled = values;
+	detail::shuffle(shuffled.begin(), shuffled.end(), generator);
+	EXPECT_NE(values, shuffled);
+	std::sort(shuffled.begin(), shuffled.end());
+	EXPECT_EQ(values, shuffled);
+}
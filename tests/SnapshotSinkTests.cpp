@@ -0,0 +1,55 @@
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+#include <cstdio>
+#include "SnapshotSink.hpp"
+
+using namespace testing;
+
+namespace
+{
+	Snapshot<3, int64_t> makeSnapshot(int64_t solution, uint64_t evaluations)
+	{
+		Snapshot<3, int64_t> snapshot;
+		snapshot.m_solution = solution;
+		snapshot.m_keyboard.m_keys = { 2, 0, 1 };
+		snapshot.m_evaluations = evaluations;
+		snapshot.m_time = 0.5;
+		return snapshot;
+	}
+}
+
+TEST(SnapshotSinkTests, RingBufferKeepsTheLatest)
+{
+	SnapshotRingBuffer<3, int64_t> ring(3);
+	ring(makeSnapshot(-10, 1));
+	ring(makeSnapshot(-9, 2));
+	EXPECT_EQ(2u, ring.snapshots().size());
+	ring(makeSnapshot(-8, 3));
+	ring(makeSnapshot(-7, 4));
+	auto snapshots = ring.snapshots();
+	ASSERT_EQ(3u, snapshots.size());
+	EXPECT_EQ(2u, snapshots[0].m_evaluations);
+	EXPECT_EQ(3u, snapshots[1].m_evaluations);
+	EXPECT_EQ(4u, snapshots[2].m_evaluations);
+}
+
+TEST(SnapshotSinkTests, FileIsAppendedTo)
+{
+	const std::string filename = "snapshots.bin";
+	std::remove(filename.c_str());
+	{
+		SnapshotFile<3, int64_t> file(filename);
+		file(makeSnapshot(-10, 1));
+	}
+	{
+		SnapshotFile<3, int64_t> file(filename);
+		file(makeSnapshot(-9, 2));
+	}
+	auto snapshots = SnapshotFile<3, int64_t>::read(filename);
+	std::remove(filename.c_str());
+	ASSERT_EQ(2u, snapshots.size());
+	EXPECT_EQ(-10, snapshots[0].m_solution);
+	EXPECT_EQ(-9, snapshots[1].m_solution);
+	EXPECT_EQ(2u, snapshots[1].m_evaluations);
+	EXPECT_EQ(snapshots[0].m_keyboard.m_keys, makeSnapshot(0, 0).m_keyboard.m_keys);
+}
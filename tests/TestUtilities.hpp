@@ -1,4 +1,7 @@
 #pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <string>
 
 template<typename... T>
 auto ElementsAreClose(T... v) -> decltype(ElementsAre(FloatNear(v, 0.00001f)...))
@@ -6,3 +9,34 @@ auto ElementsAreClose(T... v) -> decltype(ElementsAre(FloatNear(v, 0.00001f)...)
 	return ElementsAre(FloatNear(v, 0.00001f)...);
 }
 
+// A file in the temporary directory, which is removed when it goes out of scope
+class TemporaryFile
+{
+public:
+	explicit TemporaryFile(const std::string& name)
+	{
+		const char* directory = nullptr;
+		for (const char* variable : { "TMPDIR", "TEMP", "TMP" })
+		{
+			directory = directory ? directory : std::getenv(variable);
+		}
+		m_filename = std::string(directory ? directory : "/tmp") + "/" + name;
+		std::remove(m_filename.c_str());
+	}
+
+	TemporaryFile(const TemporaryFile&) = delete;
+	TemporaryFile& operator=(const TemporaryFile&) = delete;
+
+	~TemporaryFile()
+	{
+		std::remove(m_filename.c_str());
+	}
+
+	const std::string& filename() const
+	{
+		return m_filename;
+	}
+
+private:
+	std::string m_filename;
+};
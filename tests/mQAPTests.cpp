@@ -18,6 +18,22 @@ TEST(mQAPTests, ObjectiveFunctionWorksCorrectly)
 	EXPECT_EQ(-193446, objective2.evaluate(keyboard));
 }
 
+TEST(mQAPTests, ObjectivesCanBeCreatedFromTheSameInstance)
+{
+	auto instance = detail::loadmQAPInstance("../../tests/mQAPData/KC30-3fl-1rl.dat");
+	EXPECT_EQ(30, instance.m_numLocations);
+	EXPECT_EQ(3, instance.m_numObjectives);
+	Keyboard<30> keyboard;
+	std::mt19937 randomGenerator(1);
+	keyboard.randomize(randomGenerator);
+	for (size_t i = 0; i < 3; i++)
+	{
+		mQAP<30> fromFile("../../tests/mQAPData/KC30-3fl-1rl.dat", i);
+		mQAP<30> fromInstance(instance, i);
+		EXPECT_EQ(fromFile.evaluate(keyboard), fromInstance.evaluate(keyboard));
+	}
+}
+
 template<typename Solutions>
 void checkResult(const std::string& resultFilename, Solutions& solutions)
 {